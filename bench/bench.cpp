@@ -0,0 +1,177 @@
+#include "snapshot.h"
+#include "bytereader.h"
+#include "bytewriter.h"
+#include "common.h"
+#include <chrono>
+#include <string>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Times the hot paths of recording and loading on synthetic smaps content,
+// parsing and encoding and decoding of snapshots, so that changes to them
+// can be measured without a busy machine to record.
+//
+//   heaphawk_bench [mappings] [iterations]
+
+static const char* PATHS[] = {
+    "",
+    "[heap]",
+    "/usr/lib/x86_64-linux-gnu/libc.so.6",
+    "/usr/lib/x86_64-linux-gnu/libstdc++.so.6.0.30",
+    "/usr/bin/someservice",
+    "[stack]",
+};
+
+// smaps of a process with the given number of mappings, the values are
+// varied by round so consecutive contents differ like those of sweeps
+static std::string syntheticSmaps(int mappings, int round) {
+    std::string smaps;
+    char line[512];
+    uint64_t address = 0x7f0000000000;
+    for (int i = 0; i < mappings; i++) {
+        const char* path = PATHS[i % (sizeof(PATHS) / sizeof(PATHS[0]))];
+        uint64_t size = 4 * (1 + i % 64);
+        uint64_t rss = (i % 3 == 0) ? (size + round) % (size + 1) : size / 2;
+        snprintf(line, sizeof(line), "%lx-%lx rw-p 00000000 00:00 %d %s\n",
+                 static_cast<unsigned long>(address),
+                 static_cast<unsigned long>(address + size * 1024),
+                 *path == '/' ? 1000 + i : 0,
+                 path);
+        smaps += line;
+        address += size * 1024 + 0x1000;
+
+        snprintf(line, sizeof(line),
+                 "Size:               %4lu kB\n"
+                 "KernelPageSize:        4 kB\n"
+                 "MMUPageSize:           4 kB\n"
+                 "Rss:                %4lu kB\n"
+                 "Pss:                %4lu kB\n"
+                 "Pss_Dirty:          %4lu kB\n"
+                 "Shared_Clean:          0 kB\n"
+                 "Shared_Dirty:          0 kB\n"
+                 "Private_Clean:         0 kB\n"
+                 "Private_Dirty:      %4lu kB\n"
+                 "Referenced:         %4lu kB\n"
+                 "Anonymous:          %4lu kB\n",
+                 static_cast<unsigned long>(size),
+                 static_cast<unsigned long>(rss),
+                 static_cast<unsigned long>(rss),
+                 static_cast<unsigned long>(rss),
+                 static_cast<unsigned long>(rss),
+                 static_cast<unsigned long>(rss),
+                 static_cast<unsigned long>(rss));
+        smaps += line;
+        smaps +=
+            "KSM:                   0 kB\n"
+            "LazyFree:              0 kB\n"
+            "AnonHugePages:         0 kB\n"
+            "ShmemPmdMapped:        0 kB\n"
+            "FilePmdMapped:         0 kB\n"
+            "Shared_Hugetlb:        0 kB\n"
+            "Private_Hugetlb:       0 kB\n"
+            "Swap:                  0 kB\n"
+            "SwapPss:               0 kB\n"
+            "Locked:                0 kB\n"
+            "THPeligible:    0\n"
+            "VmFlags: rd wr mr mw me ac sd\n";
+    }
+    return smaps;
+}
+
+static double millisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char* argv[]) {
+    int mappings = argc > 1 ? atoi(argv[1]) : 1000;
+    int iterations = argc > 2 ? atoi(argv[2]) : 200;
+    if (mappings <= 0 || iterations <= 0) {
+        printf("usage: heaphawk_bench [mappings] [iterations]\n");
+        return 1;
+    }
+
+    // two contents, alternated like consecutive sweeps of one process
+    std::string contents[2] = {syntheticSmaps(mappings, 0), syntheticSmaps(mappings, 1)};
+    printf("%d mappings, %zu bytes of smaps, %d iterations\n", mappings, contents[0].size(), iterations);
+
+    Snapshot snapshot;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        snapshot.reset(1, i);
+        if (!snapshot.parse(contents[i % 2])) {
+            printf("failed to parse synthetic smaps\n");
+            return 1;
+        }
+    }
+    double parse = millisecondsSince(start);
+    printf("parse:  %8.3f ms per snapshot, %7.1f MB/s\n",
+           parse / iterations,
+           contents[0].size() * iterations / parse / 1000.0);
+
+    // the first snapshot of a process is written standalone, the
+    // following ones as deltas to their predecessor
+    Snapshot first(1, 0);
+    Snapshot second(1, 1000);
+    if (!first.parse(contents[0]) || !second.parse(contents[1])) {
+        printf("failed to parse synthetic smaps\n");
+        return 1;
+    }
+
+    ByteWriter standalone;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        standalone.clear();
+        first.writeToFile(standalone, nullptr);
+    }
+    double encodeStandalone = millisecondsSince(start);
+
+    ByteWriter delta;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        delta.clear();
+        second.writeToFile(delta, &first);
+    }
+    double encodeDelta = millisecondsSince(start);
+
+    std::map<ProcessIdentity, std::unique_ptr<Snapshot>> bases;
+    auto base = std::make_unique<Snapshot>();
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        base->recycle();
+        ByteReader reader(standalone.data());
+        if (base->readFromFile(reader, ARCHIVE_VERSION, bases) != Snapshot::ReadFileResult::ok) {
+            printf("failed to decode standalone snapshot\n");
+            return 1;
+        }
+    }
+    double decodeStandalone = millisecondsSince(start);
+    bases[base->identity()] = std::move(base);
+
+    Snapshot decoded;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        decoded.recycle();
+        ByteReader reader(delta.data());
+        if (decoded.readFromFile(reader, ARCHIVE_VERSION, bases) != Snapshot::ReadFileResult::ok) {
+            printf("failed to decode delta snapshot\n");
+            return 1;
+        }
+    }
+    double decodeDelta = millisecondsSince(start);
+
+    if (!decoded.isEqualTo(second)) {
+        printf("decoded snapshot differs from the encoded one\n");
+        return 1;
+    }
+
+    printf("encode: %8.3f ms standalone, %8.3f ms delta, %zu and %zu bytes\n",
+           encodeStandalone / iterations,
+           encodeDelta / iterations,
+           standalone.offset(),
+           delta.offset());
+    printf("decode: %8.3f ms standalone, %8.3f ms delta\n",
+           decodeStandalone / iterations,
+           decodeDelta / iterations);
+
+    return 0;
+}
@@ -0,0 +1,70 @@
+#include "allocationcounter.h"
+#include <inttypes.h>
+#include <stdio.h>
+
+#ifdef HEAPHAWK_COUNT_ALLOCATIONS
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+
+static std::atomic<uint64_t> allocations;
+static std::atomic<uint64_t> allocatedBytes;
+
+static void* countedAllocation(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    return malloc(size > 0 ? size : 1);
+}
+
+void* operator new(size_t size) {
+    auto p = countedAllocation(size);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return countedAllocation(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return countedAllocation(size);
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+    free(p);
+}
+
+AllocationCount allocationCount() {
+    return {allocations.load(std::memory_order_relaxed), allocatedBytes.load(std::memory_order_relaxed)};
+}
+
+void printAllocationCount(const char* what, const AllocationCount& start) {
+    auto count = allocationCount() - start;
+    printf("%s did %" PRIu64 " allocations of %" PRIu64 " bytes\n", what, count.mAllocations, count.mBytes);
+}
+#else
+AllocationCount allocationCount() {
+    return {};
+}
+
+void printAllocationCount(const char*, const AllocationCount&) {
+}
+#endif
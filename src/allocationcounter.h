@@ -0,0 +1,20 @@
+#pragma once
+#include <stdint.h>
+
+// Counts the allocations done with operator new when built with
+// HEAPHAWK_COUNT_ALLOCATIONS, to see how much recording and loading
+// allocate. Allocations of C libraries (e.g. zlib) are not counted.
+struct AllocationCount {
+    uint64_t mAllocations = 0;
+    uint64_t mBytes = 0;
+
+    AllocationCount operator - (const AllocationCount& other) const {
+        return {mAllocations - other.mAllocations, mBytes - other.mBytes};
+    }
+};
+
+// all zero without HEAPHAWK_COUNT_ALLOCATIONS
+AllocationCount allocationCount();
+
+// prints the allocations since start, nothing without HEAPHAWK_COUNT_ALLOCATIONS
+void printAllocationCount(const char* what, const AllocationCount& start);
@@ -0,0 +1,97 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <string_view>
+
+// Bounds checked cursor over a block of memory, e.g. a memory mapped
+// archive or a decompressed frame. All reads return false instead of
+// reading past the end.
+class ByteReader {
+public:
+    ByteReader() = default;
+
+    ByteReader(const char* data, size_t size) : mData(data), mSize(size) {}
+
+    explicit ByteReader(std::string_view data) : mData(data.data()), mSize(data.size()) {}
+
+    size_t offset() const { return mOffset; }
+
+    size_t size() const { return mSize; }
+
+    bool atEnd() const { return mOffset >= mSize; }
+
+    bool seek(size_t offset) {
+        if (offset > mSize) {
+            return false;
+        }
+        mOffset = offset;
+        return true;
+    }
+
+    bool readUInt8(uint8_t& value) {
+        if (mOffset >= mSize) {
+            return false;
+        }
+        value = static_cast<uint8_t>(mData[mOffset++]);
+        return true;
+    }
+
+    template<class T>
+    bool readFixed(T& value) {
+        if (mSize - mOffset < sizeof(T)) {
+            return false;
+        }
+        memcpy(&value, mData + mOffset, sizeof(T));
+        mOffset += sizeof(T);
+        return true;
+    }
+
+    bool readUInt32(uint32_t& value) { return readFixed(value); }
+
+    bool readInt32(int32_t& value) { return readFixed(value); }
+
+    bool readUInt64(uint64_t& value) { return readFixed(value); }
+
+    bool readInt64(int64_t& value) { return readFixed(value); }
+
+    // LEB128, see ByteWriter::writeVarUInt64()
+    bool readVarUInt64(uint64_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 64 && mOffset < mSize; shift += 7) {
+            auto c = static_cast<uint8_t>(mData[mOffset++]);
+            value |= static_cast<uint64_t>(c & 0x7f) << shift;
+            if (!(c & 0x80)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // returns a view into the underlying memory
+    bool readBytes(size_t length, std::string_view& value) {
+        if (mSize - mOffset < length) {
+            return false;
+        }
+        value = std::string_view(mData + mOffset, length);
+        mOffset += length;
+        return true;
+    }
+
+    bool readVarString(std::string_view& value) {
+        uint64_t length;
+        return readVarUInt64(length) && readBytes(length, value);
+    }
+
+    // int32 length followed by the characters, as written by version 1
+    bool readString(std::string_view& value) {
+        int32_t length;
+        return readInt32(length) && length >= 0 && readBytes(static_cast<size_t>(length), value);
+    }
+
+private:
+    const char* mData = nullptr;
+
+    size_t mSize = 0;
+
+    size_t mOffset = 0;
+};
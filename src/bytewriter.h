@@ -0,0 +1,61 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <string_view>
+
+// Growable buffer that values are appended to, the counterpart of
+// ByteReader. A sweep is encoded into one of these and handed to a Sink
+// as a whole, so nothing is written to the archive piecemeal.
+class ByteWriter {
+public:
+    size_t offset() const { return mData.size(); }
+
+    std::string_view data() const { return mData; }
+
+    // keeps the allocated memory for the next use
+    void clear() { mData.clear(); }
+
+    void writeUInt8(uint8_t value) {
+        mData.push_back(static_cast<char>(value));
+    }
+
+    template<class T>
+    void writeFixed(T value) {
+        char buf[sizeof(T)];
+        memcpy(buf, &value, sizeof(T));
+        mData.append(buf, sizeof(T));
+    }
+
+    void writeUInt32(uint32_t value) { writeFixed(value); }
+
+    void writeInt32(int32_t value) { writeFixed(value); }
+
+    void writeUInt64(uint64_t value) { writeFixed(value); }
+
+    void writeInt64(int64_t value) { writeFixed(value); }
+
+    // LEB128, 7 bits per byte, least significant group first
+    void writeVarUInt64(uint64_t value) {
+        char buf[10];
+        int length = 0;
+        while (value >= 0x80) {
+            buf[length++] = static_cast<char>((value & 0x7f) | 0x80);
+            value >>= 7;
+        }
+        buf[length++] = static_cast<char>(value);
+        mData.append(buf, length);
+    }
+
+    void writeBytes(std::string_view value) {
+        mData.append(value.data(), value.size());
+    }
+
+    void writeVarString(std::string_view value) {
+        writeVarUInt64(value.size());
+        writeBytes(value);
+    }
+
+private:
+    std::string mData;
+};
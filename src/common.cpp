@@ -1,4 +1,5 @@
 #include "common.h"
+#include <time.h>
 
 std::vector<std::string> splitString(const std::string& s)
 {
@@ -26,54 +27,42 @@ std::vector<std::string> splitString(const std::string& s)
     return parts;
 }
 
-
-bool writeInt32(std::ofstream& stream, int32_t value) {
-    stream.write(reinterpret_cast<const char*>(&value), sizeof(value));
-    return true;
-}
-
-bool writeUInt32(std::ofstream& stream, uint32_t value) {
-    stream.write(reinterpret_cast<const char*>(&value), sizeof(value));
-    return true;
-}
-
-bool writeInt64(std::ofstream& stream, int64_t value) {
-    stream.write(reinterpret_cast<const char*>(&value), sizeof(value));
-    return true;
+int64_t currentTimeMillis() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
 }
 
-bool writeUInt64(std::ofstream& stream, uint64_t value) {
-    stream.write(reinterpret_cast<const char*>(&value), sizeof(value));
-    return true;
-}
+uint64_t hashBytes(std::string_view data) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (auto c : data) {
+        hash = (hash ^ static_cast<uint8_t>(c)) * 0x100000001b3ULL;
+    }
 
-bool writeString(std::ofstream& stream, const std::string& value) {
-    writeInt32(stream, value.length());
-    stream.write(value.c_str(), value.length());
-    return true;
+    return hash ? hash : 1;
 }
 
-bool readInt32(std::ifstream& stream, int32_t& value) {
+bool readInt32(std::istream& stream, int32_t& value) {
     stream.read(reinterpret_cast<char*>(&value), sizeof(value));
     return true;
 }
 
-bool readUInt32(std::ifstream& stream, uint32_t& value) {
+bool readUInt32(std::istream& stream, uint32_t& value) {
     stream.read(reinterpret_cast<char*>(&value), sizeof(value));
     return true;
 }
 
-bool readInt64(std::ifstream& stream, int64_t& value) {
+bool readInt64(std::istream& stream, int64_t& value) {
     stream.read(reinterpret_cast<char*>(&value), sizeof(value));
     return true;
 }
 
-bool readUInt64(std::ifstream& stream, uint64_t& value) {
+bool readUInt64(std::istream& stream, uint64_t& value) {
     stream.read(reinterpret_cast<char*>(&value), sizeof(value));
     return true;
 }
 
-bool readString(std::ifstream& stream, std::string& value) {
+bool readString(std::istream& stream, std::string& value) {
     int length = 0;
     if (!readInt32(stream, length)) {        
         return false;
@@ -1,6 +1,7 @@
 #pragma once
 #include <vector>
 #include <string>
+#include <string_view>
 #include <chrono>
 #include <fstream>
 #include <stdint.h>
@@ -9,27 +10,49 @@
 
 #define DEFAULT_SAMPLE_FILE_NAME "heaphawk.snapshots"
 
-constexpr std::chrono::seconds DEFAULT_SAMPLING_INTERVAL = std::chrono::seconds(60);
+// version 1: fixed size fields
+// version 2: varints, zigzag deltas and per process string tables
+// version 3: version 2 snapshots in (compressed) frames, see frame.h
+// version 4: keyframes and an index file next to the archive, see index.h
+// version 5: timestamps in milliseconds instead of seconds
+// version 6: process start times, also in killed markers
+constexpr uint32_t ARCHIVE_VERSION = 6;
+
+constexpr std::chrono::milliseconds DEFAULT_SAMPLING_INTERVAL = std::chrono::seconds(60);
+
+// number of sweeps after which all processes are written without delta base
+constexpr int DEFAULT_KEYFRAME_INTERVAL = 60;
+
+// heap growth in kB after which a process is upgraded from rollup to full smaps
+constexpr int64_t DEFAULT_ROLLUP_UPGRADE_THRESHOLD = 100 * 1024;
 
 std::vector<std::string> splitString(const std::string& s);
 
-bool writeInt32(std::ofstream& stream, int32_t value);
+// wall clock time in milliseconds since the epoch, used for timestamps
+int64_t currentTimeMillis();
 
-bool writeUInt32(std::ofstream& stream, uint32_t value);
+// 64 bit FNV-1a, never returns 0 so that 0 can mean "no hash"
+uint64_t hashBytes(std::string_view data);
 
-bool writeInt64(std::ofstream& stream, int64_t value);
+inline uint64_t combineHashes(uint64_t hash, uint64_t value) {
+    return (hash ^ value) * 0x100000001b3ULL;
+}
 
-bool writeUInt64(std::ofstream& stream, uint64_t value);
+inline uint64_t zigzagEncode(int64_t value) {
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
 
-bool writeString(std::ofstream& stream, const std::string& value);
+inline int64_t zigzagDecode(uint64_t value) {
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
 
-bool readInt32(std::ifstream& stream, int32_t& value);
+bool readInt32(std::istream& stream, int32_t& value);
 
-bool readUInt32(std::ifstream& stream, uint32_t& value);
+bool readUInt32(std::istream& stream, uint32_t& value);
 
-bool readInt64(std::ifstream& stream, int64_t& value);
+bool readInt64(std::istream& stream, int64_t& value);
 
-bool readUInt64(std::ifstream& stream, uint64_t& value);
+bool readUInt64(std::istream& stream, uint64_t& value);
 
-bool readString(std::ifstream& stream, std::string& value);
+bool readString(std::istream& stream, std::string& value);
 
@@ -1,246 +1,418 @@
 #include "entry.h"
 #include "common.h"
 #include "snapshot.h"
+#include "stringtable.h"
+#include "bytereader.h"
+#include "bytewriter.h"
 #include <inttypes.h>
 #include <array>
+#include <tuple>
 
-enum class Type {
-    typeUInt64,
-    typeString,
-};
+// One serialized member of Entry. The index is the bit in the flags word
+// of an entry and must never change for a given member.
+template<class T>
+struct Field {
+    using Type = T;
 
-struct ValueDescBase {
-    ValueDescBase(const std::string name, Type type, size_t index) : mName(name), mType(type), mIndex(index) {}
+    T Entry::* mMember;
 
-    virtual void writeValue(std::ofstream& stream, uint32_t& flags, const Entry& curEntry, const Entry* prevEntry) const = 0;
+    uint32_t mIndex;
 
-    virtual void readValue(std::ifstream& stream, uint32_t flags, Entry& curEntry, const Entry* prevEntry) const = 0;
+    const char* mName;
 
-    virtual bool equals(const Entry& a, const Entry& b) const = 0;
+    constexpr uint32_t bit() const { return 1u << mIndex; }
+};
 
-    std::string mName;
+#define UINT64_FIELD(name, index) Field<uint64_t>{&Entry::m##name, index, #name}
+#define STRING_FIELD(name, index) Field<std::string>{&Entry::m##name, index, #name}
+
+// All serialized members. This is a tuple rather than an array of virtual
+// descriptors, so that every loop over the fields is unrolled at compile
+// time with the member offsets as constants.
+static constexpr auto FIELDS = std::make_tuple(
+    UINT64_FIELD(From, 0),
+    UINT64_FIELD(To, 1),
+
+    STRING_FIELD(Permissions, 2),
+    UINT64_FIELD(Offset, 3),
+    STRING_FIELD(Device, 4),
+    STRING_FIELD(PathName, 5),
+
+    UINT64_FIELD(Size, 6),
+    UINT64_FIELD(KernelPageSize, 7),
+    UINT64_FIELD(MMUPageSize, 8),
+    UINT64_FIELD(Rss, 9),
+    UINT64_FIELD(Shared_Clean, 10),
+    UINT64_FIELD(Shared_Dirty, 11),
+    UINT64_FIELD(Private_Clean, 12),
+    UINT64_FIELD(Private_Dirty, 13),
+    UINT64_FIELD(Referenced, 14),
+    UINT64_FIELD(Anonymous, 15),
+    UINT64_FIELD(KSM, 16),
+    UINT64_FIELD(LazyFree, 17),
+    UINT64_FIELD(AnonHugePages, 18),
+    UINT64_FIELD(ShmemPmdMapped, 19),
+    UINT64_FIELD(Shared_Hugetlb, 20),
+    UINT64_FIELD(Private_Hugetlb, 21),
+    UINT64_FIELD(Swap, 22),
+    UINT64_FIELD(SwapPss, 23),
+    UINT64_FIELD(Locked, 24),
+    UINT64_FIELD(FilePmdMapped, 25)
+);
+
+// mFrom is coded by the snapshot, all other fields by the entry
+static constexpr uint32_t FROM_BIT = std::get<0>(FIELDS).bit();
+
+static constexpr uint32_t PATH_NAME_BIT = std::get<5>(FIELDS).bit();
+
+// calls func(field) for every field
+template<class Func>
+static inline void forEachField(Func&& func) {
+    std::apply([&](const auto&... field) { (func(field), ...); }, FIELDS);
+}
 
-    Type mType;
+// calls func(field) for every field until it returns false
+template<class Func>
+static inline bool allFields(Func&& func) {
+    return std::apply([&](const auto&... field) { return (func(field) && ...); }, FIELDS);
+}
 
-    size_t mIndex;
-};
+// the value a new value is encoded relative to
+static inline uint64_t deltaBase(const Field<uint64_t>& field, const Entry& curEntry, const Entry* prevEntry) {
+    if (prevEntry) {
+        return prevEntry->*field.mMember;
+    }
 
-template<class T>
-struct ValueDesc : public ValueDescBase {
+    // the end address of a new mapping is close to its start address
+    if (field.mMember == &Entry::mTo) {
+        return curEntry.mFrom;
+    }
 
-    using MemberPointer = T Entry::*;
+    return 0;
+}
 
-    ValueDesc(const std::string& name, Type type, MemberPointer ptr, size_t index) : ValueDescBase(name, type, index), mMember(ptr) {}
+static inline void writeValue(ByteWriter& writer, const Field<uint64_t>& field, const Entry& curEntry, const Entry* prevEntry, StringTable&) {
+    auto delta = static_cast<int64_t>(curEntry.*field.mMember - deltaBase(field, curEntry, prevEntry));
+    writer.writeVarUInt64(zigzagEncode(delta));
+}
 
-    void writeValue(std::ofstream& stream, uint32_t& flags, const Entry& curEntry, const Entry* prevEntry) const override;
+static inline void writeValue(ByteWriter& writer, const Field<std::string>& field, const Entry& curEntry, const Entry*, StringTable& strings) {
+    // an index equal to the table size introduces a new string
+    const auto& value = curEntry.*field.mMember;
+    auto index = strings.find(value);
+    writer.writeVarUInt64(index);
+    if (index == strings.size()) {
+        writer.writeVarString(value);
+        strings.add(value);
+    }
+}
 
-    void readValue(std::ifstream& stream, uint32_t flags, Entry& curEntry, const Entry* prevEntry) const override;
+static inline bool readValue(ByteReader& reader, const Field<uint64_t>& field, Entry& curEntry, const Entry* prevEntry, StringTable&) {
+    uint64_t value;
+    if (!reader.readVarUInt64(value)) {
+        return false;
+    }
 
-    virtual bool equals(const Entry& a, const Entry& b) const override;
+    curEntry.*field.mMember = deltaBase(field, curEntry, prevEntry) + static_cast<uint64_t>(zigzagDecode(value));
+    return true;
+}
 
-    T Entry::*mMember;
-};
+static inline bool readValue(ByteReader& reader, const Field<std::string>& field, Entry& curEntry, const Entry*, StringTable& strings) {
+    uint64_t index;
+    if (!reader.readVarUInt64(index)) {
+        return false;
+    }
 
-template<>
-void ValueDesc<uint64_t>::writeValue(std::ofstream& stream, uint32_t& flags, const Entry& curEntry, const Entry* prevEntry) const {
-    auto value = curEntry.*mMember;
-    if (prevEntry) {
-        auto prevValue = prevEntry->*mMember;
-        if (value == prevValue) {
-            return;
+    if (index == strings.size()) {
+        std::string_view value;
+        if (!reader.readVarString(value)) {
+            return false;
         }
+        strings.add(value);
     }
-    flags |= (1 << mIndex);
-    writeUInt64(stream, value);
-}
 
-template<>
-void ValueDesc<std::string>::writeValue(std::ofstream& stream, uint32_t& flags, const Entry& curEntry, const Entry* prevEntry) const {
-    auto value = curEntry.*mMember;
-    if (prevEntry) {
-        auto prevValue = prevEntry->*mMember;
-        if (value == prevValue) {
-            return;
-        }
+    auto value = strings.at(static_cast<uint32_t>(index));
+    if (!value) {
+        printf("invalid string index %d\n", static_cast<int>(index));
+        return false;
     }
-    flags |= (1 << mIndex);
-    writeString(stream, value);
+
+    curEntry.*field.mMember = *value;
+    return true;
 }
 
-template<>
-void ValueDesc<uint64_t>::readValue(std::ifstream& stream, uint32_t flags, Entry& curEntry, const Entry* prevEntry) const {
-    if (flags & (1 << mIndex)) {
-        uint64_t value;
-        stream.read(reinterpret_cast<char*>(&value), sizeof(value));
-        curEntry.*mMember = value;
-    } else {
-        curEntry.*mMember = prevEntry->*mMember;
-    }
+static inline bool readValueV1(ByteReader& reader, const Field<uint64_t>& field, Entry& curEntry) {
+    return reader.readUInt64(curEntry.*field.mMember);
 }
 
-template<>
-void ValueDesc<std::string>::readValue(std::ifstream& stream, uint32_t flags, Entry& curEntry, const Entry* prevEntry) const {
-    if (flags & (1 << mIndex)) {
-        std::string value;
-        readString(stream, value);
-        curEntry.*mMember = value;
-    } else {
-        curEntry.*mMember = prevEntry->*mMember;
+static inline bool readValueV1(ByteReader& reader, const Field<std::string>& field, Entry& curEntry) {
+    std::string_view value;
+    if (!reader.readString(value)) {
+        return false;
     }
+    curEntry.*field.mMember = value;
+    return true;
 }
 
-template<class T>
-bool ValueDesc<T>::equals(const Entry& a, const Entry& b) const {
-    return a.*mMember == b.*mMember;
-}
+MappingKind Entry::classify(const std::string& pathName) {
+    if (pathName.empty()) {
+        return MappingKind::anonymous;
+    }
 
-template<>
-bool ValueDesc<uint64_t>::equals(const Entry& a, const Entry& b) const {
-    return (a.*mMember) == (b.*mMember);
-}
+    if (pathName[0] != '[') {
+        return MappingKind::file;
+    }
 
+    if (pathName == "[heap]") {
+        return MappingKind::heap;
+    }
 
-#define MAKE_UINT64_VALUE(name, index) new ValueDesc<uint64_t>(#name, Type::typeUInt64, &Entry::m##name, index)
-#define MAKE_STRING_VALUE(name, index) new ValueDesc<std::string>(#name, Type::typeString, &Entry::m##name, index)
-
-const std::array<ValueDescBase*, 26>& valueDescs() {
-    static const std::array<ValueDescBase*, 26> ValueDescs = {
-        MAKE_UINT64_VALUE(From, 0),
-        MAKE_UINT64_VALUE(To, 1),
-
-        MAKE_STRING_VALUE(Permissions, 2),
-        MAKE_UINT64_VALUE(Offset, 3),
-        MAKE_STRING_VALUE(Device, 4),
-        MAKE_STRING_VALUE(PathName, 5),
-
-        MAKE_UINT64_VALUE(Size, 6),
-        MAKE_UINT64_VALUE(KernelPageSize, 7),
-        MAKE_UINT64_VALUE(MMUPageSize, 8),
-        MAKE_UINT64_VALUE(Rss, 9),
-        MAKE_UINT64_VALUE(Shared_Clean, 10),
-        MAKE_UINT64_VALUE(Shared_Dirty, 11),
-        MAKE_UINT64_VALUE(Private_Clean, 12),
-        MAKE_UINT64_VALUE(Private_Dirty, 13),
-        MAKE_UINT64_VALUE(Referenced, 14),
-        MAKE_UINT64_VALUE(Anonymous, 15),
-        MAKE_UINT64_VALUE(KSM, 16),
-        MAKE_UINT64_VALUE(LazyFree, 17),
-        MAKE_UINT64_VALUE(AnonHugePages, 18),
-        MAKE_UINT64_VALUE(ShmemPmdMapped, 19),
-        MAKE_UINT64_VALUE(Shared_Hugetlb, 20),
-        MAKE_UINT64_VALUE(Private_Hugetlb, 21),
-        MAKE_UINT64_VALUE(Swap, 22),
-        MAKE_UINT64_VALUE(SwapPss, 23),
-        MAKE_UINT64_VALUE(Locked, 24),
-        MAKE_UINT64_VALUE(FilePmdMapped, 25)
-    };
-
-    return ValueDescs;
+    if (pathName == "[stack]") {
+        return MappingKind::stack;
+    }
+
+    if (pathName == "[rollup]") {
+        return MappingKind::rollup;
+    }
+
+    return MappingKind::special;
 }
 
-bool Entry::operator == (const Entry& other) const {
-    for (const auto* desc : valueDescs()) {
-        if (!desc->equals(*this, other)) {
-            return false;
-        }
+const char* Entry::kindName(MappingKind kind) {
+    switch (kind) {
+    case MappingKind::heap:
+        return "heap";
+    case MappingKind::anonymous:
+        return "anonymous";
+    case MappingKind::stack:
+        return "stack";
+    case MappingKind::rollup:
+        return "rollup";
+    case MappingKind::special:
+        return "special";
+    case MappingKind::file:
+        return "file";
+    default:
+        return "unknown";
     }
+}
 
-    return true;
+int64_t Entry::heapUsage() const {
+    switch (mKind) {
+    case MappingKind::heap:
+    case MappingKind::anonymous:
+        return static_cast<int64_t>(mReferenced);
+    case MappingKind::rollup:
+        // smaps_rollup does not break memory down by mapping, so the
+        // anonymous memory of the whole process is the closest match
+        return static_cast<int64_t>(mAnonymous);
+    default:
+        return 0;
+    }
+}
+
+bool Entry::operator == (const Entry& other) const {
+    return allFields([&](const auto& field) {
+        return this->*field.mMember == other.*field.mMember;
+    });
 }
 
 bool Entry::operator != (const Entry& other) const {
-    for (const auto* desc : valueDescs()) {
-        if (!desc->equals(*this, other)) {
-            return true;
-        }
+    return !(*this == other);
+}
+
+// Maps a smaps value name to the corresponding member. Dispatching on the
+// length first leaves at most a handful of candidates to compare against.
+static uint64_t Entry::* findValueMember(std::string_view name) {
+    switch (name.length()) {
+    case 3:
+        if (name == "Rss") return &Entry::mRss;
+        if (name == "KSM") return &Entry::mKSM;
+        break;
+    case 4:
+        if (name == "Size") return &Entry::mSize;
+        if (name == "Swap") return &Entry::mSwap;
+        break;
+    case 6:
+        if (name == "Locked") return &Entry::mLocked;
+        break;
+    case 7:
+        if (name == "SwapPss") return &Entry::mSwapPss;
+        break;
+    case 8:
+        if (name == "LazyFree") return &Entry::mLazyFree;
+        break;
+    case 9:
+        if (name == "Anonymous") return &Entry::mAnonymous;
+        break;
+    case 10:
+        if (name == "Referenced") return &Entry::mReferenced;
+        break;
+    case 11:
+        if (name == "MMUPageSize") return &Entry::mMMUPageSize;
+        break;
+    case 12:
+        if (name == "Shared_Clean") return &Entry::mShared_Clean;
+        if (name == "Shared_Dirty") return &Entry::mShared_Dirty;
+        break;
+    case 13:
+        if (name == "Private_Clean") return &Entry::mPrivate_Clean;
+        if (name == "Private_Dirty") return &Entry::mPrivate_Dirty;
+        if (name == "AnonHugePages") return &Entry::mAnonHugePages;
+        if (name == "FilePmdMapped") return &Entry::mFilePmdMapped;
+        break;
+    case 14:
+        if (name == "KernelPageSize") return &Entry::mKernelPageSize;
+        if (name == "ShmemPmdMapped") return &Entry::mShmemPmdMapped;
+        if (name == "Shared_Hugetlb") return &Entry::mShared_Hugetlb;
+        break;
+    case 15:
+        if (name == "Private_Hugetlb") return &Entry::mPrivate_Hugetlb;
+        break;
     }
 
-    return false;
+    return nullptr;
 }
 
 // example: "1084 kB"
-Entry::ParseResult Entry::parseValue(const std::string& name, const std::string& valueAndUnit) {
-
-    const ValueDescBase* valueDesc = nullptr;
-    for (const auto* desc : valueDescs()) {
-        if (desc->mName == name) {
-            valueDesc = desc;
-            break;
-        }
+Entry::ParseResult Entry::parseValue(std::string_view name, std::string_view valueAndUnit) {
+    auto member = findValueMember(name);
+    if (!member) {
+        //printf("warning: value %.*s not found in descs\n", static_cast<int>(name.length()), name.data());
+        return ParseResult::unknown;
     }
 
-    if (!valueDesc) {
-        //printf("warning: value %s not found in descs\n", name.c_str());
-        return ParseResult::unknown;
+    size_t pos = 0;
+    while (pos < valueAndUnit.length() && (valueAndUnit[pos] == ' ' || valueAndUnit[pos] == '\t')) {
+        pos++;
     }
 
-    auto parts = splitString(valueAndUnit);
+    auto digitsStart = pos;
+    uint64_t value = 0;
+    while (pos < valueAndUnit.length() && valueAndUnit[pos] >= '0' && valueAndUnit[pos] <= '9') {
+        value = value * 10 + static_cast<uint64_t>(valueAndUnit[pos] - '0');
+        pos++;
+    }
 
-    if (parts.size() != 2) {
-        printf("parts != 2 (%d)\n", static_cast<int>(parts.size()));
+    if (pos == digitsStart) {
+        printf("failed to parse value %.*s\n", static_cast<int>(valueAndUnit.length()), valueAndUnit.data());
         return ParseResult::error;
     }
 
-    if (parts[1] != "kB") {
-        printf("parts 1 is not kB but \"%s\"", parts[1].c_str());
-        return ParseResult::error;
+    while (pos < valueAndUnit.length() && (valueAndUnit[pos] == ' ' || valueAndUnit[pos] == '\t')) {
+        pos++;
     }
 
-    uint64_t value;
-    auto rd = sscanf(parts[0].c_str(), "%" PRIu64, &value);
-    if (rd != 1) {
-        printf("failed to parse value %s\n", parts[0].c_str());
-        return ParseResult::error;
+    auto unit = valueAndUnit.substr(pos);
+    while (!unit.empty() && (unit.back() == ' ' || unit.back() == '\t' || unit.back() == '\r')) {
+        unit.remove_suffix(1);
     }
 
-    if (valueDesc->mType == Type::typeUInt64) {
-        auto vd = reinterpret_cast<const ValueDesc<uint64_t>*>(valueDesc);
-        this->*vd->mMember = value;
-    } else if (valueDesc->mType == Type::typeString) {
-        auto vd = reinterpret_cast<const ValueDesc<std::string>*>(valueDesc);
-        this->*vd->mMember = value;
+    if (unit != "kB") {
+        printf("unit is not kB but \"%.*s\"\n", static_cast<int>(unit.length()), unit.data());
+        return ParseResult::error;
     }
 
+    this->*member = value;
     return ParseResult::ok;
 }
 
-bool Entry::write(std::ofstream& stream, const Entry* prevEntry) const {
-    bool ok = true;
-    writeInt32(stream, 0x12563478); // sync
-
-    writeUInt64(stream, mFrom);
+// mFrom is written by the snapshot, see Snapshot::writeToFile()
+bool Entry::write(ByteWriter& writer, const Entry* prevEntry, StringTable& strings) const {
+    // parsed from the same lines, nothing changed
+    if (prevEntry && mHash != 0 && mHash == prevEntry->mHash) {
+        writer.writeVarUInt64(0);
+        return true;
+    }
 
     uint32_t flags = 0;
-    auto flagsPos = stream.tellp();
+    forEachField([&](const auto& field) {
+        if (field.bit() == FROM_BIT) {
+            return;
+        }
+
+        if (!prevEntry || this->*field.mMember != prevEntry->*field.mMember) {
+            flags |= field.bit();
+        }
+    });
 
-    writeUInt32(stream, flags);
-    for (const auto* desc : valueDescs()) {
-        if (desc->mName == "From") {
-            continue;
+    writer.writeVarUInt64(flags);
+    forEachField([&](const auto& field) {
+        if (flags & field.bit()) {
+            writeValue(writer, field, *this, prevEntry, strings);
         }
+    });
+
+    return true;
+}
 
-        desc->writeValue(stream, flags, *this, prevEntry);
+// mFrom has to be set already, see Snapshot::readFromFile()
+bool Entry::read(ByteReader& reader, const Entry* prevEntry, StringTable& strings) {
+    uint64_t flags = 0;
+    if (!reader.readVarUInt64(flags)) {
+        return false;
     }
 
-    auto endPos = stream.tellp();
+    bool ok = allFields([&](const auto& field) {
+        if (field.bit() == FROM_BIT) {
+            return true;
+        }
+
+        if (flags & field.bit()) {
+            return readValue(reader, field, *this, prevEntry, strings);
+        }
 
-    stream.seekp(flagsPos);
-    writeUInt32(stream, flags);
+        if (!prevEntry) {
+            printf("missing value %s for new entry\n", field.mName);
+            return false;
+        }
+        this->*field.mMember = prevEntry->*field.mMember;
+        return true;
+    });
 
-    stream.seekp(endPos);
-    return ok;
+    if (!ok) {
+        return false;
+    }
+
+    updateKind(prevEntry, flags & PATH_NAME_BIT);
+    return true;
 }
 
-bool Entry::read(std::ifstream& stream, const Snapshot* prevSnapshot) {
-    bool ok = true;
+void Entry::updateKind(const Entry* prevEntry, bool pathChanged) {
+    if (prevEntry && !pathChanged) {
+        mKind = prevEntry->mKind;
+    } else {
+        mKind = classify(mPathName);
+    }
+}
 
-    int sync;
-    readInt32(stream, sync);
+void Entry::reset() {
+    auto permissions = std::move(mPermissions);
+    auto device = std::move(mDevice);
+    auto pathName = std::move(mPathName);
+
+    *this = Entry();
+
+    mPermissions = std::move(permissions);
+    mDevice = std::move(device);
+    mPathName = std::move(pathName);
+    mPermissions.clear();
+    mDevice.clear();
+    mPathName.clear();
+}
+
+bool Entry::readV1(ByteReader& reader, const Snapshot* prevSnapshot) {
+    int32_t sync;
+    if (!reader.readInt32(sync)) {
+        return false;
+    }
     if (sync != 0x12563478) {
-        printf("out of sync at %x %d\n", sync, static_cast<int>(stream.tellg()));
+        printf("out of sync at %x %d\n", sync, static_cast<int>(reader.offset()));
     }
 
-    readUInt64(stream, mFrom);
+    if (!reader.readUInt64(mFrom)) {
+        return false;
+    }
 
     const Entry* prevEntry = nullptr;
     if (prevSnapshot) {
@@ -248,14 +420,30 @@ bool Entry::read(std::ifstream& stream, const Snapshot* prevSnapshot) {
     }
 
     uint32_t flags = 0;
-    readUInt32(stream, flags);
-    for (const auto* desc : valueDescs()) {
-        if (desc->mName == "From") {
-            continue;
+    if (!reader.readUInt32(flags)) {
+        return false;
+    }
+
+    bool ok = allFields([&](const auto& field) {
+        if (field.bit() == FROM_BIT) {
+            return true;
         }
 
-        desc->readValue(stream, flags, *this, prevEntry);
+        if (flags & field.bit()) {
+            return readValueV1(reader, field, *this);
+        }
+
+        if (!prevEntry) {
+            return false;
+        }
+        this->*field.mMember = prevEntry->*field.mMember;
+        return true;
+    });
+
+    if (!ok) {
+        return false;
     }
 
-    return ok;
+    updateKind(prevEntry, flags & PATH_NAME_BIT);
+    return true;
 }
@@ -2,9 +2,29 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <string>
+#include <string_view>
 #include <fstream>
 
 class Snapshot;
+class StringTable;
+class ByteReader;
+class ByteWriter;
+
+// what a mapping is used for, derived from its path name
+enum class MappingKind : uint8_t {
+    // [heap]
+    heap,
+    // no path name, e.g. mmap'ed allocator arenas
+    anonymous,
+    // [stack]
+    stack,
+    // [rollup], all mappings of a process from smaps_rollup
+    rollup,
+    // other pseudo paths like [vdso] or [vvar]
+    special,
+    file,
+    count,
+};
 
 class Entry {
 public:
@@ -18,11 +38,28 @@ public:
 
     bool operator != (const Entry& other) const;
 
-    bool write(std::ofstream& stream, const Entry* prevEntry) const;
+    bool write(ByteWriter& writer, const Entry* prevEntry, StringTable& strings) const;
+
+    bool read(ByteReader& reader, const Entry* prevEntry, StringTable& strings);
+
+    // reads an entry from a version 1 archive
+    bool readV1(ByteReader& reader, const Snapshot* prevSnapshot);
+
+    ParseResult parseValue(std::string_view name, std::string_view valueAndUnit);
 
-    bool read(std::ifstream& stream, const Snapshot* prevSnapshot);
+    static MappingKind classify(const std::string& pathName);
 
-    ParseResult parseValue(const std::string& name, const std::string& valueAndUnit);
+    // lower case name of the kind for reports
+    static const char* kindName(MappingKind kind);
+
+    // sets mKind, reusing the one of prevEntry if the path did not change
+    void updateKind(const Entry* prevEntry, bool pathChanged);
+
+    // sets all values to the defaults, the strings keep their capacity
+    void reset();
+
+    // the part of this mapping counted as heap usage
+    int64_t heapUsage() const;
 
     uint64_t mFrom;
     uint64_t mTo;
@@ -34,6 +71,12 @@ public:
     std::string mDevice;
     std::string mPathName;
 
+    // not stored in archives, always derived from mPathName
+    MappingKind mKind = MappingKind::anonymous;
+
+    // hash of the smaps lines this entry was parsed from, 0 if unknown
+    uint64_t mHash = 0;
+
     uint64_t mSize = 0;
     uint64_t mKernelPageSize = 0;
     uint64_t mMMUPageSize = 0;
@@ -0,0 +1,264 @@
+#include "frame.h"
+#include "common.h"
+#include "bytereader.h"
+#include "bytewriter.h"
+#include "sink.h"
+#include <array>
+#include <stdio.h>
+
+#ifdef HEAPHAWK_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+static constexpr uint32_t FRAME_MAGIC = 0x46484848; // "HHHF"
+
+static constexpr uint8_t KEYFRAME_FLAG = 0x80;
+
+// frames are never bigger than one sweep, anything beyond is corruption
+static constexpr uint32_t MAX_FRAME_SIZE = 1024 * 1024 * 1024;
+
+std::optional<Compression> compressionFromString(const std::string& name) {
+    if (name == "none") {
+        return Compression::none;
+    }
+
+    if (name == "zlib") {
+        return Compression::zlib;
+    }
+
+    return {};
+}
+
+bool isCompressionSupported(Compression compression) {
+    switch (compression) {
+    case Compression::none:
+        return true;
+    case Compression::zlib:
+#ifdef HEAPHAWK_HAVE_ZLIB
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    return false;
+}
+
+Compression defaultCompression() {
+    if (isCompressionSupported(Compression::zlib)) {
+        return Compression::zlib;
+    }
+
+    return Compression::none;
+}
+
+uint32_t frameCrc32(const char* data, size_t length) {
+    static const auto table = [] {
+        std::array<uint32_t, 256> table;
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+            }
+            table[i] = c;
+        }
+        return table;
+    }();
+
+    uint32_t crc = 0xffffffff;
+    for (size_t i = 0; i < length; i++) {
+        crc = table[(crc ^ static_cast<uint8_t>(data[i])) & 0xff] ^ (crc >> 8);
+    }
+
+    return crc ^ 0xffffffff;
+}
+
+static bool compress(Compression compression, std::string_view data, std::string& compressed) {
+    switch (compression) {
+    case Compression::none:
+        compressed = data;
+        return true;
+    case Compression::zlib: {
+#ifdef HEAPHAWK_HAVE_ZLIB
+        auto length = compressBound(data.size());
+        compressed.resize(length);
+        auto res = compress2(reinterpret_cast<Bytef*>(compressed.data()),
+                             &length,
+                             reinterpret_cast<const Bytef*>(data.data()),
+                             data.size(),
+                             Z_DEFAULT_COMPRESSION);
+        if (res != Z_OK) {
+            printf("failed to compress frame (%d)\n", res);
+            return false;
+        }
+        compressed.resize(length);
+        return true;
+#else
+        return false;
+#endif
+    }
+    }
+
+    return false;
+}
+
+static bool decompress(Compression compression, std::string_view compressed, uint32_t rawSize, std::string& buffer, std::string_view& data) {
+    switch (compression) {
+    case Compression::none:
+        data = compressed;
+        return data.size() == rawSize;
+    case Compression::zlib: {
+#ifdef HEAPHAWK_HAVE_ZLIB
+        buffer.resize(rawSize);
+        uLongf length = rawSize;
+        auto res = uncompress(reinterpret_cast<Bytef*>(buffer.data()),
+                              &length,
+                              reinterpret_cast<const Bytef*>(compressed.data()),
+                              compressed.size());
+        if (res != Z_OK || length != rawSize) {
+            printf("failed to decompress frame (%d)\n", res);
+            return false;
+        }
+        data = buffer;
+        return true;
+#else
+        (void)rawSize;
+        (void)buffer;
+        printf("archive is zlib compressed, but %s was built without zlib\n", APP_NAME);
+        return false;
+#endif
+    }
+    }
+
+    printf("unknown frame compression %d\n", static_cast<int>(compression));
+    return false;
+}
+
+bool writeFrame(Sink& sink, Compression compression, bool keyframe, std::string_view data) {
+    static thread_local std::string payload;
+    static thread_local ByteWriter frame;
+
+    std::string_view stored = data;
+    if (compression != Compression::none) {
+        if (!compress(compression, data, payload)) {
+            return false;
+        }
+        stored = payload;
+    }
+
+    auto type = static_cast<uint8_t>(compression);
+    if (keyframe) {
+        type |= KEYFRAME_FLAG;
+    }
+
+    frame.clear();
+    frame.writeUInt32(FRAME_MAGIC);
+    frame.writeUInt8(type);
+    frame.writeUInt32(static_cast<uint32_t>(stored.size()));
+    frame.writeUInt32(static_cast<uint32_t>(data.size()));
+    frame.writeUInt32(frameCrc32(stored.data(), stored.size()));
+    frame.writeBytes(stored);
+
+    return sink.write(frame.data());
+}
+
+struct FrameHeader {
+    uint8_t mType = 0;
+    uint32_t mPayloadSize = 0;
+    uint32_t mRawSize = 0;
+    uint32_t mCrc = 0;
+};
+
+static ReadFrameResult readFrameHeader(ByteReader& reader, FrameHeader& header) {
+    if (reader.atEnd()) {
+        return ReadFrameResult::end;
+    }
+
+    auto frameOffset = reader.offset();
+
+    uint32_t magic = 0;
+    if (!reader.readUInt32(magic)
+        || !reader.readUInt8(header.mType)
+        || !reader.readUInt32(header.mPayloadSize)
+        || !reader.readUInt32(header.mRawSize)
+        || !reader.readUInt32(header.mCrc)) {
+        return ReadFrameResult::truncated;
+    }
+
+    if (magic != FRAME_MAGIC || header.mPayloadSize > MAX_FRAME_SIZE || header.mRawSize > MAX_FRAME_SIZE) {
+        printf("invalid frame header at %d\n", static_cast<int>(frameOffset));
+        return ReadFrameResult::truncated;
+    }
+
+    return ReadFrameResult::ok;
+}
+
+ReadFrameResult skipFrame(ByteReader& reader, bool& keyframe) {
+    FrameHeader header;
+    auto res = readFrameHeader(reader, header);
+    if (res != ReadFrameResult::ok) {
+        return res;
+    }
+
+    keyframe = (header.mType & KEYFRAME_FLAG) != 0;
+
+    std::string_view payload;
+    if (!reader.readBytes(header.mPayloadSize, payload)) {
+        return ReadFrameResult::truncated;
+    }
+
+    return ReadFrameResult::ok;
+}
+
+ReadFrameResult readFrame(ByteReader& reader, std::string& buffer, std::string_view& data, bool& keyframe) {
+    FrameHeader header;
+    auto res = readFrameHeader(reader, header);
+    if (res != ReadFrameResult::ok) {
+        return res;
+    }
+
+    keyframe = (header.mType & KEYFRAME_FLAG) != 0;
+    auto compression = static_cast<Compression>(header.mType & ~KEYFRAME_FLAG);
+
+    std::string_view payload;
+    if (!reader.readBytes(header.mPayloadSize, payload)
+        || frameCrc32(payload.data(), payload.size()) != header.mCrc) {
+        return ReadFrameResult::truncated;
+    }
+
+    if (!decompress(compression, payload, header.mRawSize, buffer, data)) {
+        return ReadFrameResult::failed;
+    }
+
+    return ReadFrameResult::ok;
+}
+
+bool isTornFrame(const ByteReader& reader) {
+    // the rest of the file, a frame is written with a single write, so a
+    // crash leaves a prefix of it or, on some file systems, zeros
+    ByteReader restReader = reader;
+    std::string_view rest;
+    restReader.readBytes(reader.size() - reader.offset(), rest);
+    if (rest.find_first_not_of('\0') == std::string_view::npos) {
+        return true;
+    }
+
+    ByteReader frameReader(rest);
+    uint32_t magic = 0;
+    FrameHeader header;
+    if (!frameReader.readUInt32(magic)
+        || !frameReader.readUInt8(header.mType)
+        || !frameReader.readUInt32(header.mPayloadSize)
+        || !frameReader.readUInt32(header.mRawSize)
+        || !frameReader.readUInt32(header.mCrc)) {
+        return magic == FRAME_MAGIC || rest.size() < sizeof(magic);
+    }
+
+    if (magic != FRAME_MAGIC) {
+        return false;
+    }
+
+    // a payload running past the end was cut off, a complete one with a
+    // wrong checksum only counts if nothing follows it
+    return frameReader.size() - frameReader.offset() <= header.mPayloadSize;
+}
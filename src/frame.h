@@ -0,0 +1,60 @@
+#pragma once
+#include <stdint.h>
+#include <optional>
+#include <string>
+#include <string_view>
+
+class ByteReader;
+class Sink;
+
+// Archives of version 3 and later consist of frames. Every frame holds the
+// snapshots of one sweep and can be decompressed on its own, so a crash
+// while writing loses at most the last frame. All snapshots in a keyframe
+// are written without a delta base, so decoding can start at any keyframe.
+//
+// frame layout:
+//   uint32 magic
+//   uint8  compression, the highest bit marks keyframes (version 4)
+//   uint32 payload size (as stored)
+//   uint32 raw size (after decompression)
+//   uint32 crc32 of the stored payload
+//   payload
+
+enum class Compression : uint8_t {
+    none = 0,
+    zlib = 1,
+};
+
+enum class ReadFrameResult {
+    ok,
+    // clean end of file
+    end,
+    // incomplete or corrupted frame, usually the tail of an interrupted recording
+    truncated,
+    failed,
+};
+
+std::optional<Compression> compressionFromString(const std::string& name);
+
+bool isCompressionSupported(Compression compression);
+
+Compression defaultCompression();
+
+// hands the whole frame to the sink in a single write
+bool writeFrame(Sink& sink, Compression compression, bool keyframe, std::string_view data);
+
+// data either points into the memory of reader (uncompressed frames) or
+// into buffer
+ReadFrameResult readFrame(ByteReader& reader, std::string& buffer, std::string_view& data, bool& keyframe);
+
+// checks only the frame header and that the payload is complete, for
+// walking over frames without decoding them
+ReadFrameResult skipFrame(ByteReader& reader, bool& keyframe);
+
+// true if the frame at the position of reader was cut off by a crash
+// while it was written, as opposed to an archive corrupted elsewhere
+bool isTornFrame(const ByteReader& reader);
+
+// CRC-32 as in zip and zlib, named apart from zlib's crc32() so the two
+// cannot be confused when zlib is linked
+uint32_t frameCrc32(const char* data, size_t length);
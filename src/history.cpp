@@ -1,12 +1,90 @@
 #include "history.h"
+#include "allocationcounter.h"
 #include "snapshot.h"
 #include "process.h"
 #include "common.h"
+#include "frame.h"
+#include "index.h"
+#include "bytereader.h"
+#include "mappedfile.h"
+#include "segment.h"
+#include "threadpool.h"
 #include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <fstream>
+#include <inttypes.h>
+#include <mutex>
+#include <thread>
+
+// Chunks are cut at the first keyframe after this many bytes of frames, so
+// archives with a keyframe in every frame are not split into tiny tasks.
+static constexpr uint64_t MIN_CHUNK_SIZE = 256 * 1024;
+
+struct History::Chunk {
+    struct Frame {
+        uint64_t mOffset;
+        uint64_t mEnd;
+        bool mKeyframe;
+
+        // set by decodeChunk(), frames after one that is not ok are not read
+        ReadFrameResult mResult = ReadFrameResult::ok;
+
+        // a snapshot in the frame could not be read, the ones before it
+        // are in mSnapshots
+        bool mFailed = false;
+
+        // index in mSnapshots after the last snapshot of the frame
+        size_t mSnapshotEnd = 0;
+    };
+
+    std::vector<Frame> mFrames;
+
+    std::vector<std::unique_ptr<Snapshot>> mSnapshots;
+
+    // killed markers among mSnapshots
+    std::vector<char> mKilled;
+
+    // Processes whose first snapshot in the chunk is outside of a keyframe
+    // and was read without delta base. That is only right if they have no
+    // delta base before the chunk either.
+    std::vector<ProcessIdentity> mUnbased;
+
+    // recycled snapshots to decode into, sorted by the process they had
+    std::vector<std::pair<ProcessIdentity, std::unique_ptr<Snapshot>>> mSpares;
+
+    // the spare of the same process, which has about the same size, any
+    // other one or a new one
+    std::unique_ptr<Snapshot> spareSnapshot(const ByteReader& reader, uint32_t version) {
+        ProcessIdentity identity;
+        if (Snapshot::peekIdentity(reader, version, identity)) {
+            auto it = std::lower_bound(mSpares.begin(), mSpares.end(), identity, [](const auto& spare, const ProcessIdentity& value) {
+                return spare.first < value;
+            });
+            for (; it != mSpares.end() && it->first == identity; ++it) {
+                if (it->second) {
+                    return std::move(it->second);
+                }
+            }
+        }
+
+        while (!mSpares.empty()) {
+            auto snapshot = std::move(mSpares.back().second);
+            mSpares.pop_back();
+            if (snapshot) {
+                return snapshot;
+            }
+        }
+        return std::make_unique<Snapshot>();
+    }
+
+    // guarded by the mutex in loadChunks()
+    bool mDecoded = false;
+};
 
 History::History() {
+    mJobCount = std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
 }
 
 History::~History() {
@@ -19,86 +97,643 @@ void History::setSampleFilePath(const std::string& sampleFilePath) {
     mSampleFilePath = sampleFilePath;
 }
 
+void History::setJobCount(int jobCount) {
+    mJobCount = std::max(jobCount, 1);
+}
+
 void History::load(LoadHint hint) {
-    std::ifstream stream(mSampleFilePath, stream.binary|stream.in);
-    if (!stream.is_open()) {
+    auto paths = archivePaths(mSampleFilePath);
+    if (paths.empty()) {
         printf("failed to open archive file %s\n", mSampleFilePath.c_str());
         return;
     }
 
+    // segments of a rotated recording are stitched into one timeline
+    auto allocationStart = allocationCount();
+    int processedSnapshotCount = 0;
+    for (const auto& path : paths) {
+        loadArchive(path, hint, processedSnapshotCount);
+    }
+
+    addLastSnapshots();
+    printf("did process %d snapshots for %d processes\n", processedSnapshotCount, static_cast<int>(mProcesses.size()));
+    printAllocationCount("loading", allocationStart);
+}
+
+void History::loadArchive(const std::string& path, LoadHint hint, int& processedSnapshotCount) {
+    MappedFile file;
+    if (!file.open(path)) {
+        printf("failed to open archive file %s\n", path.c_str());
+        return;
+    }
+
+    ByteReader reader(file.view());
+
     uint32_t version;
-    if (!readUInt32(stream, version)) {
-        printf("failed to read version from archive file\n");
+    if (!reader.readUInt32(version)) {
+        printf("failed to read version from archive file %s\n", path.c_str());
         return;
     }
 
-    if (version != 1) {
-        printf("invalid archive file version %u, expected 1", version);
+    if (version < 1 || version > ARCHIVE_VERSION) {
+        printf("invalid archive file version %u, expected 1 to %u\n", version, ARCHIVE_VERSION);
         return;
     }
 
-    int processedSnapshotCount = 0;
-    while (!stream.eof() && stream.peek() != EOF) {
-        auto snapshot = new Snapshot();
-        auto res = snapshot->readFromFile(stream, mPrevSnapshots);
-        if (res == Snapshot::ReadFileResult::killed) {
-            delete snapshot;
-            continue;
+    if (version >= 4
+        && hint == LoadHint::firstAndLast
+        && loadFromIndex(path, file, version, processedSnapshotCount)) {
+        return;
+    }
+
+    if (version < 3) {
+        readSnapshots(reader, version, false, hint, processedSnapshotCount);
+        return;
+    }
+
+    // the snapshots in the frames use the version 2 encoding, frames from
+    // a keyframe on do not depend on the ones before
+    if (version >= 4 && mJobCount > 1) {
+        loadChunks(reader, file, version, hint, processedSnapshotCount);
+        return;
+    }
+
+    std::string buffer;
+    while (readNextFrame(reader, file, buffer, version, hint, processedSnapshotCount)) {
+    }
+}
+
+bool History::readNextFrame(ByteReader& reader, MappedFile& file, std::string& buffer, uint32_t version, LoadHint hint, int& processedSnapshotCount) {
+    bool keyframe = false;
+    std::string_view frame;
+    auto res = readFrame(reader, buffer, frame, keyframe);
+    if (res == ReadFrameResult::end) {
+        return false;
+    }
+
+    if (res == ReadFrameResult::truncated) {
+        printf("archive ends with an incomplete frame, ignoring it\n");
+        return false;
+    }
+
+    if (res == ReadFrameResult::failed) {
+        printf("failed to read frame from file\n");
+        return false;
+    }
+
+    ByteReader frameReader(frame);
+    if (!readSnapshots(frameReader, version, keyframe, hint, processedSnapshotCount)) {
+        return false;
+    }
+    addUnchangedToTrends(keyframe);
+    file.release(reader.offset());
+    return true;
+}
+
+void History::loadChunks(ByteReader& reader, MappedFile& file, uint32_t version, LoadHint hint, int& processedSnapshotCount) {
+    // only the frame headers are read here
+    std::vector<Chunk> chunks;
+    uint64_t chunkSize = 0;
+    ReadFrameResult scanResult;
+    while (true) {
+        auto offset = reader.offset();
+        bool keyframe = false;
+        scanResult = skipFrame(reader, keyframe);
+        if (scanResult != ReadFrameResult::ok) {
+            break;
         }
 
-        if (res == Snapshot::ReadFileResult::failed) {
-            delete snapshot;
-            if (stream.eof()) {
+        if (chunks.empty() || (keyframe && chunkSize >= MIN_CHUNK_SIZE)) {
+            chunks.emplace_back();
+            chunkSize = 0;
+        }
+
+        Chunk::Frame frame;
+        frame.mOffset = offset;
+        frame.mEnd = reader.offset();
+        frame.mKeyframe = keyframe;
+        chunks.back().mFrames.push_back(frame);
+        chunkSize += frame.mEnd - frame.mOffset;
+    }
+
+    if (!mThreadPool) {
+        mThreadPool = std::make_unique<ThreadPool>(mJobCount);
+    }
+
+    // a few chunks ahead are decoded while one is added, which bounds the
+    // memory of decoded snapshots
+    std::mutex mutex;
+    std::condition_variable chunkDecoded;
+    size_t submitted = 0;
+    std::vector<std::pair<ProcessIdentity, std::unique_ptr<Snapshot>>> spares;
+    auto submit = [&] {
+        auto chunk = &chunks[submitted++];
+        std::sort(spares.begin(), spares.end(), [](const auto& a, const auto& b) {
+            return a.first < b.first;
+        });
+        chunk->mSpares.swap(spares);
+        mThreadPool->submit([&, chunk, version] {
+            decodeChunk(*chunk, file, version);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            chunk->mDecoded = true;
+            chunkDecoded.notify_all();
+        });
+    };
+
+    auto inFlight = static_cast<size_t>(mJobCount) * 2;
+    while (submitted < chunks.size() && submitted < inFlight) {
+        submit();
+    }
+
+    bool complete = true;
+    for (auto& chunk : chunks) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            chunkDecoded.wait(lock, [&] { return chunk.mDecoded; });
+        }
+
+        mCollectRecycled = true;
+        bool ok = addChunk(chunk, file, version, hint, processedSnapshotCount);
+        appendSeries();
+        mCollectRecycled = false;
+
+        // the spares of the decoded chunk come back with the snapshots
+        // that were not used, the next chunk gets all of them
+        spares.clear();
+        for (auto& spare : chunk.mSpares) {
+            if (spare.second) {
+                spares.push_back(std::move(spare));
+            }
+        }
+        chunk.mSpares.clear();
+        for (auto& snapshot : mRecycled) {
+            auto identity = snapshot->identity();
+            snapshot->recycle();
+            spares.emplace_back(identity, std::move(snapshot));
+        }
+        mRecycled.clear();
+        for (auto& snapshot : chunk.mSnapshots) {
+            if (snapshot) {
+                auto identity = snapshot->identity();
+                snapshot->recycle();
+                spares.emplace_back(identity, std::move(snapshot));
+            }
+        }
+        chunk.mSnapshots.clear();
+        chunk.mKilled.clear();
+
+        if (!ok) {
+            complete = false;
+            break;
+        }
+
+        if (submitted < chunks.size()) {
+            submit();
+        }
+    }
+
+    // the tasks use the chunks and the locals above
+    mThreadPool->wait();
+
+    if (complete && scanResult == ReadFrameResult::truncated) {
+        printf("archive ends with an incomplete frame, ignoring it\n");
+    } else if (complete && scanResult == ReadFrameResult::failed) {
+        printf("failed to read frame from file\n");
+    }
+}
+
+void History::decodeChunk(Chunk& chunk, const MappedFile& file, uint32_t version) {
+    // delta bases within the chunk, null for ended processes
+    std::map<ProcessIdentity, Snapshot*> prevSnapshots;
+    const std::map<ProcessIdentity, Snapshot*> noPrevSnapshots;
+
+    ByteReader reader(file.view());
+    std::string buffer;
+    for (auto& frame : chunk.mFrames) {
+        reader.seek(frame.mOffset);
+        bool keyframe = false;
+        std::string_view data;
+        frame.mResult = readFrame(reader, buffer, data, keyframe);
+        if (frame.mResult != ReadFrameResult::ok) {
+            break;
+        }
+
+        ByteReader frameReader(data);
+        while (!frameReader.atEnd()) {
+            auto snapshot = chunk.spareSnapshot(frameReader, version);
+
+            // reading a delta without its base usually fails
+            auto res = snapshot->readFromFile(frameReader, version, keyframe ? noPrevSnapshots : prevSnapshots);
+            bool killed = res == Snapshot::ReadFileResult::killed;
+            if (!killed && !keyframe && prevSnapshots.find(snapshot->identity()) == prevSnapshots.end()) {
+                chunk.mUnbased.push_back(snapshot->identity());
+            }
+
+            if (res == Snapshot::ReadFileResult::failed) {
+                frame.mFailed = true;
                 break;
             }
-            printf("failed to read snapshot from file\n");
+            prevSnapshots[snapshot->identity()] = killed ? nullptr : snapshot.get();
+
+            chunk.mSnapshots.push_back(std::move(snapshot));
+            chunk.mKilled.push_back(killed);
+        }
+
+        frame.mSnapshotEnd = chunk.mSnapshots.size();
+        if (frame.mFailed) {
             break;
         }
+    }
+}
 
-        auto it = mProcesses.find(snapshot->processId());
-        Process* process;
-        if (it == mProcesses.end()) {
-            process = new Process(snapshot->processId(), snapshot->name());
-            mProcesses[process->processId()] = process;
-        } else {
-            process = it->second;
+bool History::addChunk(Chunk& chunk, MappedFile& file, uint32_t version, LoadHint hint, int& processedSnapshotCount) {
+    // A process left out of a keyframe, e.g. because its smaps could not be
+    // read, still has a delta base from before the chunk. The chunk was
+    // decoded wrong then and is read again in order.
+    for (const auto& identity : chunk.mUnbased) {
+        if (mDeltaBases.find(identity) != mDeltaBases.end()) {
+            ByteReader reader(file.view());
+            reader.seek(chunk.mFrames.front().mOffset);
+            std::string buffer;
+            for (size_t i = 0; i < chunk.mFrames.size(); i++) {
+                if (!readNextFrame(reader, file, buffer, version, hint, processedSnapshotCount)) {
+                    return false;
+                }
+            }
+            return true;
         }
+    }
 
-        if (hint == LoadHint::all
-            || process->snapshots().empty()) {
-            process->addSnapshot(snapshot);
+    size_t index = 0;
+    for (const auto& frame : chunk.mFrames) {
+        if (frame.mResult == ReadFrameResult::truncated) {
+            printf("archive ends with an incomplete frame, ignoring it\n");
+            return false;
         }
 
-        mPrevSnapshots[snapshot->processId()] = snapshot;
-        processedSnapshotCount++;
+        if (frame.mResult != ReadFrameResult::ok) {
+            printf("failed to read frame from file\n");
+            return false;
+        }
+
+        for (; index < frame.mSnapshotEnd; index++) {
+            bool killed = chunk.mKilled[index];
+            addSnapshot(std::move(chunk.mSnapshots[index]), killed, hint);
+            if (!killed) {
+                processedSnapshotCount++;
+            }
+        }
+
+        if (frame.mFailed) {
+            printf("failed to read snapshot from file\n");
+            return false;
+        }
+
+        addUnchangedToTrends(frame.mKeyframe);
+        file.release(frame.mEnd);
+    }
+
+    return true;
+}
+
+void History::appendSeries() {
+    if (mSeriesAppends.empty()) {
+        return;
     }
 
-    if (hint == LoadHint::firstAndLast) {
-        // add last entry
-        for (auto it : mPrevSnapshots) {
-            auto* snapshot = it.second;
-            auto it2 = mProcesses.find(snapshot->processId());
-            Process* process;
-            if (it2 == mProcesses.end()) {
-                process = new Process(snapshot->processId(), snapshot->name());
-                mProcesses[process->processId()] = process;
-            } else {
-                process = it2->second;
+    // shared with the tasks, which may only start after the work is done
+    struct Work {
+        std::vector<std::pair<Process*, const Snapshot*>> mAppends;
+        std::vector<size_t> mStarts;
+        std::atomic<size_t> mNext{0};
+        std::mutex mMutex;
+        std::condition_variable mDone;
+        size_t mDoneCount = 0;
+
+        void run() {
+            while (true) {
+                auto group = mNext.fetch_add(1);
+                if (group + 1 >= mStarts.size()) {
+                    return;
+                }
+
+                for (auto i = mStarts[group]; i < mStarts[group + 1]; i++) {
+                    mAppends[i].first->series().append(*mAppends[i].second);
+                }
+
+                std::lock_guard<std::mutex> lock(mMutex);
+                mDoneCount++;
+                mDone.notify_all();
             }
+        }
+    };
+
+    // the order of the snapshots of every process stays the same
+    auto work = std::make_shared<Work>();
+    work->mAppends.swap(mSeriesAppends);
+    std::stable_sort(work->mAppends.begin(), work->mAppends.end(), [](const auto& a, const auto& b) {
+        return a.first < b.first;
+    });
+    for (size_t i = 0; i < work->mAppends.size(); i++) {
+        if (i == 0 || work->mAppends[i].first != work->mAppends[i - 1].first) {
+            work->mStarts.push_back(i);
+        }
+    }
+    work->mStarts.push_back(work->mAppends.size());
+
+    auto groupCount = work->mStarts.size() - 1;
+    auto taskCount = std::min(groupCount, static_cast<size_t>(mJobCount)) - 1;
+    for (size_t i = 0; i < taskCount; i++) {
+        mThreadPool->submit([work] { work->run(); });
+    }
+    work->run();
+
+    std::unique_lock<std::mutex> lock(work->mMutex);
+    work->mDone.wait(lock, [&] { return work->mDoneCount == groupCount; });
+    lock.unlock();
+
+    // keeps the capacity for the next chunk
+    work->mAppends.clear();
+    mSeriesAppends.swap(work->mAppends);
+}
+
+Process* History::processFor(const Snapshot& snapshot) {
+    auto it = mProcesses.find(snapshot.identity());
+    if (it != mProcesses.end()) {
+        return it->second;
+    }
 
-            if (process->firstSnapshot() != snapshot) {
-                process->addSnapshot(snapshot);
+    auto process = new Process(snapshot.identity(), snapshot.name(), snapshot.isRollup());
+    mProcesses[process->identity()] = process;
+    return process;
+}
+
+std::unique_ptr<Snapshot> History::newSnapshot(const ByteReader& reader, uint32_t version) {
+    ProcessIdentity identity;
+    if (Snapshot::peekIdentity(reader, version, identity)) {
+        auto it = mSpareSnapshots.find(identity);
+        if (it != mSpareSnapshots.end() && it->second) {
+            return std::move(it->second);
+        }
+    }
+
+    if (mSpareSnapshot) {
+        return std::move(mSpareSnapshot);
+    }
+    return std::make_unique<Snapshot>();
+}
+
+void History::recycleSnapshot(std::unique_ptr<Snapshot> snapshot) {
+    if (mCollectRecycled) {
+        mRecycled.push_back(std::move(snapshot));
+        return;
+    }
+
+    auto identity = snapshot->identity();
+    snapshot->recycle();
+
+    // the map entry stays until the process ends, so this does not
+    // allocate in steady state
+    auto& spare = mSpareSnapshots[identity];
+    if (!spare) {
+        spare = std::move(snapshot);
+    }
+}
+
+void History::replaceDeltaBase(std::unique_ptr<Snapshot> snapshot) {
+    auto& base = mDeltaBases[snapshot->identity()];
+    if (base) {
+        auto process = processFor(*base);
+        if (process->snapshots().empty()
+            || std::find(mKeptSnapshots.cbegin(), mKeptSnapshots.cend(), base.get()) != mKeptSnapshots.cend()) {
+            process->addSnapshot(base.release());
+        } else {
+            recycleSnapshot(std::move(base));
+        }
+    }
+    base = std::move(snapshot);
+}
+
+void History::endDeltaBase(const ProcessIdentity& identity) {
+    auto it = mDeltaBases.find(identity);
+    if (it == mDeltaBases.end()) {
+        return;
+    }
+
+    processFor(*it->second)->addSnapshot(it->second.release());
+    mDeltaBases.erase(it);
+
+    auto spareIt = mSpareSnapshots.find(identity);
+    if (spareIt != mSpareSnapshots.end()) {
+        if (!mSpareSnapshot) {
+            mSpareSnapshot = std::move(spareIt->second);
+        }
+        mSpareSnapshots.erase(spareIt);
+    }
+}
+
+void History::addUnchangedToTrends(bool keyframe) {
+    if (mFrameIdentities.empty()) {
+        return;
+    }
+
+    if (keyframe) {
+        mKeyframeTime = mFrameStart;
+    }
+
+    // frames are in pid order, but a reused pid may come twice
+    std::sort(mFrameIdentities.begin(), mFrameIdentities.end());
+    auto changed = mFrameIdentities.cbegin();
+    for (const auto& it : mDeltaBases) {
+        while (changed != mFrameIdentities.cend() && *changed < it.first) {
+            ++changed;
+        }
+        if (changed != mFrameIdentities.cend() && *changed == it.first) {
+            continue;
+        }
+
+        const auto& base = *it.second;
+        if (base.timestamp() >= mKeyframeTime) {
+            auto process = processFor(base);
+            process->heapTrend().add(mFrameEnd, static_cast<double>(process->heapUsage(base)));
+        }
+    }
+
+    mFrameIdentities.clear();
+    mFrameEnd = 0;
+}
+
+void History::addLastSnapshots() {
+    for (auto& it : mDeltaBases) {
+        processFor(*it.second)->addSnapshot(it.second.release());
+    }
+    mDeltaBases.clear();
+    mSpareSnapshots.clear();
+    mSpareSnapshot.reset();
+}
+
+// Decodes only the first snapshot of every process and the snapshots from
+// its last standalone snapshot (usually a keyframe) up to its last one.
+bool History::loadFromIndex(const std::string& path, const MappedFile& file, uint32_t version, int& processedSnapshotCount) {
+    std::vector<IndexRecord> records;
+    if (!readIndex(indexFilePath(path), records) || records.empty()) {
+        return false;
+    }
+
+    auto fileSize = static_cast<uint64_t>(file.size());
+
+    std::map<ProcessIdentity, std::vector<const IndexRecord*>> recordsByProcess;
+    for (const auto& record : records) {
+        if (record.mFrameOffset >= fileSize) {
+            // the archive was truncated after the index was written
+            continue;
+        }
+        recordsByProcess[{record.mProcessId, record.mStartTime}].push_back(&record);
+    }
+
+    std::vector<const IndexRecord*> needed;
+    for (const auto& it : recordsByProcess) {
+        const auto& pidRecords = it.second;
+        if (!pidRecords.front()->mStandalone) {
+            printf("index does not start with a standalone snapshot for process %d\n", it.first.mProcessId);
+            return false;
+        }
+
+        size_t start = pidRecords.size() - 1;
+        while (!pidRecords[start]->mStandalone) {
+            start--;
+        }
+
+        if (start > 0) {
+            needed.push_back(pidRecords.front());
+        }
+        needed.insert(needed.end(), pidRecords.begin() + start, pidRecords.end());
+    }
+
+    // records are in file order, process them frame by frame
+    std::sort(needed.begin(), needed.end(), [](const IndexRecord* a, const IndexRecord* b) {
+        if (a->mFrameOffset != b->mFrameOffset) {
+            return a->mFrameOffset < b->mFrameOffset;
+        }
+        return a->mSnapshotOffset < b->mSnapshotOffset;
+    });
+
+    const std::map<ProcessIdentity, std::unique_ptr<Snapshot>> noPrevSnapshots;
+    ByteReader reader(file.view());
+    std::string buffer;
+    ByteReader frameReader;
+    uint64_t frameOffset = 0;
+    bool haveFrame = false;
+    for (const auto* record : needed) {
+        if (!haveFrame || record->mFrameOffset != frameOffset) {
+            reader.seek(record->mFrameOffset);
+            bool keyframe = false;
+            std::string_view frame;
+            if (readFrame(reader, buffer, frame, keyframe) != ReadFrameResult::ok) {
+                printf("failed to read frame at %" PRIu64 "\n", record->mFrameOffset);
+                break;
             }
+            frameOffset = record->mFrameOffset;
+            haveFrame = true;
+            frameReader = ByteReader(frame);
         }
+
+        if (!frameReader.seek(record->mSnapshotOffset)) {
+            printf("invalid snapshot offset for process %d in index\n", record->mProcessId);
+            return false;
+        }
+
+        auto snapshot = newSnapshot(frameReader, version);
+        auto res = snapshot->readFromFile(frameReader, version, record->mStandalone ? noPrevSnapshots : mDeltaBases);
+        if (res != Snapshot::ReadFileResult::ok
+            || snapshot->identity() != ProcessIdentity{record->mProcessId, record->mStartTime}) {
+            printf("failed to read snapshot of process %d from index position\n", record->mProcessId);
+            return false;
+        }
+
+        processFor(*snapshot);
+        replaceDeltaBase(std::move(snapshot));
+        processedSnapshotCount++;
     }
-    printf("did process %d snapshots for %d processes\n", processedSnapshotCount, static_cast<int>(mProcesses.size()));
+
+    return true;
+}
+
+bool History::readSnapshots(ByteReader& reader, uint32_t version, bool keyframe, LoadHint hint, int& processedSnapshotCount) {
+    // snapshots in keyframes have no delta base
+    const std::map<ProcessIdentity, std::unique_ptr<Snapshot>> noPrevSnapshots;
+
+    while (!reader.atEnd()) {
+        auto snapshot = newSnapshot(reader, version);
+        auto res = snapshot->readFromFile(reader, version, keyframe ? noPrevSnapshots : mDeltaBases);
+        if (res == Snapshot::ReadFileResult::failed) {
+            printf("failed to read snapshot from file\n");
+            return false;
+        }
+
+        bool killed = res == Snapshot::ReadFileResult::killed;
+        addSnapshot(std::move(snapshot), killed, hint);
+        if (!killed) {
+            processedSnapshotCount++;
+        }
+    }
+
+    return true;
+}
+
+void History::addSnapshot(std::unique_ptr<Snapshot> snapshot, bool killed, LoadHint hint) {
+    if (killed) {
+        // killed markers since version 6 tell which delta base ended,
+        // a later process with the same pid starts from scratch
+        endDeltaBase(snapshot->identity());
+        if (mCollectRecycled) {
+            mRecycled.push_back(std::move(snapshot));
+        } else if (!mSpareSnapshot) {
+            snapshot->recycle();
+            mSpareSnapshot = std::move(snapshot);
+        }
+        return;
+    }
+
+    // all snapshots go to the trend and the series, only the first one
+    // and the current delta base are kept as Snapshot
+    auto process = processFor(*snapshot);
+    process->heapTrend().add(snapshot->timestamp(), static_cast<double>(process->heapUsage(*snapshot)));
+
+    if (mFrameIdentities.empty() || snapshot->timestamp() < mFrameStart) {
+        mFrameStart = snapshot->timestamp();
+    }
+    mFrameEnd = std::max(mFrameEnd, snapshot->timestamp());
+    mFrameIdentities.push_back(snapshot->identity());
+    if (hint == LoadHint::all) {
+        if (mCollectRecycled) {
+            mSeriesAppends.push_back({process, snapshot.get()});
+        } else {
+            process->series().append(*snapshot);
+        }
+    }
+
+    if (mFirstTimestamp == 0) {
+        mFirstTimestamp = snapshot->timestamp();
+    }
+    if (snapshot->processId() == mDiffProcessId) {
+        watchSnapshot(*snapshot);
+    }
+
+    replaceDeltaBase(std::move(snapshot));
 }
 
+static constexpr double MILLISECONDS_PER_DAY = 24 * 3600 * 1000.0;
+
+// number of paths and mappings listed by diff()
+static constexpr size_t DIFF_TOP_COUNT = 10;
+
 struct SortHelper {
-    int64_t mValue;
+    double mValue;
     Process* mProcess;
 
-    SortHelper(Process* process, int64_t value) {
+    SortHelper(Process* process, double value) {
         mProcess = process;
         mValue = value;
     }
@@ -132,23 +767,33 @@ static std::string formatTimeInterval(std::chrono::seconds interval) {
 }
 
 std::vector<Process*> History::processesSortedByGrowth() {
-    // sort by used heap
+    // sort by the robust heap growth rate if all snapshots were read,
+    // otherwise by the difference of the first and the last one
     std::vector<SortHelper> processes;
     for (auto it : mProcesses) {
         auto process = it.second;
 
         auto firstSnapshot = process->firstSnapshot();
         auto lastSnapshot = process->lastSnapshot();
+        const auto& trend = process->heapTrend();
 
         int64_t startSize = 0;
         int64_t endSize = 0;
         if (firstSnapshot && lastSnapshot && firstSnapshot != lastSnapshot) {
-            startSize = firstSnapshot->calcHeapUsage();
-            endSize = lastSnapshot->calcHeapUsage();
-            int64_t deltaSize = endSize - startSize;
-            if (deltaSize > 0) {
-                processes.push_back(SortHelper(process, deltaSize));
+            startSize = process->heapUsage(*firstSnapshot);
+            endSize = process->heapUsage(*lastSnapshot);
+        }
+
+        // a single jump has no trend, but is still listed, a process
+        // that mostly shrinks is not, whatever its last snapshot says
+        int64_t deltaSize = endSize - startSize;
+        if (trend.sampleCount() >= 2) {
+            auto growthPerDay = trend.robustSlope() * MILLISECONDS_PER_DAY;
+            if (growthPerDay > 0 || (growthPerDay == 0 && deltaSize > 0)) {
+                processes.push_back(SortHelper(process, growthPerDay));
             }
+        } else if (deltaSize > 0) {
+            processes.push_back(SortHelper(process, deltaSize));
         }
     }
 
@@ -182,25 +827,37 @@ void History::summary() {
         int64_t startTime = 0;
         int64_t endTime = 0;
         if (firstSnapshot && lastSnapshot && firstSnapshot != lastSnapshot) {
-            startSize = firstSnapshot->calcHeapUsage();
-            endSize = lastSnapshot->calcHeapUsage();
+            startSize = process->heapUsage(*firstSnapshot);
+            endSize = process->heapUsage(*lastSnapshot);
             startTime = firstSnapshot->timestamp();
             endTime = lastSnapshot->timestamp();
         }
 
-        auto deltaTime = std::chrono::seconds(endTime - startTime);
+        auto deltaTime = std::chrono::milliseconds(endTime - startTime);
 
-        float growthPerDay = ((endSize - startSize) / static_cast<double>(deltaTime.count())) * 3600 * 24;
+        float growthPerDay = ((endSize - startSize) / (deltaTime.count() / 1000.0)) * 3600 * 24;
 
         printf("  [%d] %s: +%dkB heap in %s (~%.02fkB/day  %dkB - %dkB %d snapshots)\n",
                process->processId(),
                process->name().c_str(),
                static_cast<int>(endSize - startSize),
-               formatTimeInterval(deltaTime).c_str(),
+               formatTimeInterval(std::chrono::duration_cast<std::chrono::seconds>(deltaTime)).c_str(),
                growthPerDay,
                static_cast<int>(startSize),
                static_cast<int>(endSize),
                static_cast<int>(process->snapshots().size()));
+
+        // the trend needs at least 3 samples to say how well it fits
+        const auto& trend = process->heapTrend();
+        if (trend.sampleCount() >= 3) {
+            printf("      trend: %.02fkB/day +-%.02f (95%%), r2 %.02f, robust %.02fkB/day, monotonicity %.02f, %d samples\n",
+                   trend.slope() * MILLISECONDS_PER_DAY,
+                   1.96 * trend.slopeError() * MILLISECONDS_PER_DAY,
+                   trend.rSquared(),
+                   trend.robustSlope() * MILLISECONDS_PER_DAY,
+                   trend.monotonicity(),
+                   static_cast<int>(trend.sampleCount()));
+        }
     }
 }
 
@@ -221,6 +878,16 @@ static std::string replaceInString(const std::string& str, const std::string& ol
     return res;
 }
 
+static std::string csvFileName(const Process* process, const std::map<pid_t, int>& pidCounts) {
+    char fileName[128];
+    if (pidCounts.at(process->processId()) > 1) {
+        snprintf(fileName, sizeof(fileName), "process_%d_%" PRIu64 ".csv", static_cast<int>(process->processId()), process->startTime());
+    } else {
+        snprintf(fileName, sizeof(fileName), "process_%d.csv", static_cast<int>(process->processId()));
+    }
+    return std::string(fileName);
+}
+
 void History::plot() {
     auto processesSortedByGrowth = this->processesSortedByGrowth();
     if (processesSortedByGrowth.empty()) {
@@ -236,6 +903,12 @@ void History::plot() {
         "#00adad"
     };
 
+    // processes that reused a pid get the start time in the file name
+    std::map<pid_t, int> pidCounts;
+    for (const auto& process : processesSortedByGrowth) {
+        pidCounts[process->processId()]++;
+    }
+
     std::ofstream plotFile("gnuplot.plt");
 
     plotFile << "set xlabel 'Time (hours:minutes)'\n";
@@ -247,12 +920,13 @@ void History::plot() {
         auto firstSnapshot = process->firstSnapshot();
 
         // write data file
-        char fileName[128];
-        snprintf(fileName, sizeof(fileName), "process_%d.csv", static_cast<int>(process->processId()));
+        auto fileName = csvFileName(process, pidCounts);
         std::ofstream csvFile(fileName);
-        for (auto it : process->snapshots()) {
-            auto snapshot = it.second;
-            csvFile << (snapshot->timestamp() - firstSnapshot->timestamp()) << ", " << snapshot->calcHeapUsage() << "\n";
+        const auto& series = process->series();
+        auto heapUsage = series.heapUsagePerSample();
+        for (size_t i = 0; i < series.sampleCount(); i++) {
+            // seconds, with a fraction for sub-second intervals
+            csvFile << (series.timestamps()[i] - firstSnapshot->timestamp()) / 1000.0 << ", " << heapUsage[i] << "\n";
         }
 
         // write gnuplot file
@@ -271,9 +945,7 @@ void History::plot() {
 
     processCount = 0;
     for (const auto process : processesSortedByGrowth) {
-        // write data file
-        char fileName[128];
-        snprintf(fileName, sizeof(fileName), "process_%d.csv", static_cast<int>(process->processId()));
+        auto fileName = csvFileName(process, pidCounts);
 
         if (processCount > 0) {
             plotFile << ", \\\n";
@@ -296,3 +968,180 @@ void History::plot() {
 
     printf("please run \"gnuplot -p gnuplot.plt\"\n");
 }
+
+void History::diff(pid_t processId, int64_t from, int64_t to, bool timeline) {
+    mDiffProcessId = processId;
+    mDiffFrom = from;
+    mDiffTo = to;
+    mDiffTimeline = timeline;
+
+    load(LoadHint::trend);
+
+    bool found = false;
+    for (const auto& it : mProcesses) {
+        if (it.first.mProcessId == processId) {
+            printDiff(*it.second);
+            found = true;
+        }
+    }
+
+    if (!found) {
+        printf("no snapshots of process %d found\n", processId);
+    }
+}
+
+void History::watchSnapshot(const Snapshot& snapshot) {
+    auto it = mDeltaBases.find(snapshot.identity());
+    const Snapshot* prevSnapshot = it != mDeltaBases.end() ? it->second.get() : nullptr;
+
+    // times relative to the first snapshot, so mDiffTo may be the maximum
+    auto time = snapshot.timestamp() - mFirstTimestamp;
+    auto prevTime = prevSnapshot ? prevSnapshot->timestamp() - mFirstTimestamp : -1;
+    if ((time >= mDiffFrom && prevTime < mDiffFrom)
+        || (time >= mDiffTo && prevTime < mDiffTo)) {
+        mKeptSnapshots.push_back(&snapshot);
+    }
+
+    if (!mDiffTimeline || !prevSnapshot) {
+        return;
+    }
+
+    mDiff.compute(*prevSnapshot, snapshot, processFor(snapshot)->isRollup());
+    if (mDiff.heapDelta() == 0 || mDiff.paths().empty()) {
+        return;
+    }
+
+    // the path that moved the most in the same direction as the heap
+    const auto& top = mDiff.heapDelta() > 0 ? mDiff.paths().front() : mDiff.paths().back();
+
+    TimelineStep step;
+    step.mIdentity = snapshot.identity();
+    step.mTimestamp = snapshot.timestamp();
+    step.mHeap = mDiff.heapDelta();
+    step.mRss = mDiff.rssDelta();
+    step.mTopName = std::string(top.mName);
+    step.mTopHeap = top.mHeap;
+    mTimeline.push_back(std::move(step));
+}
+
+// with tenths of seconds for short recordings
+static std::string formatOffset(int64_t milliseconds) {
+    if (milliseconds < 60 * 1000) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%.1fs", milliseconds / 1000.0);
+        return std::string(buf);
+    }
+    return formatTimeInterval(std::chrono::duration_cast<std::chrono::seconds>(std::chrono::milliseconds(milliseconds)));
+}
+
+static std::string describeChange(const SnapshotDiff::Change& change) {
+    const auto& entry = change.mTo ? *change.mTo : *change.mFrom;
+    auto name = SnapshotDiff::displayName(entry);
+
+    char range[64];
+    snprintf(range, sizeof(range), "%" PRIx64 "-%" PRIx64, entry.mFrom, entry.mTo);
+
+    char buf[512];
+    if (!change.mFrom) {
+        snprintf(buf, sizeof(buf), "%s %s %.*s (new)", range, entry.mPermissions.c_str(), static_cast<int>(name.size()), name.data());
+    } else if (!change.mTo) {
+        snprintf(buf, sizeof(buf), "%s %s %.*s (removed)", range, entry.mPermissions.c_str(), static_cast<int>(name.size()), name.data());
+    } else if (change.mFrom->mFrom != change.mTo->mFrom || change.mFrom->mTo != change.mTo->mTo) {
+        bool overlaps = change.mFrom->mFrom < change.mTo->mTo && change.mTo->mFrom < change.mFrom->mTo;
+        snprintf(buf, sizeof(buf), "%s %s %.*s (%s from %" PRIx64 "-%" PRIx64 ")",
+                 range, entry.mPermissions.c_str(), static_cast<int>(name.size()), name.data(),
+                 overlaps ? "resized" : "moved", change.mFrom->mFrom, change.mFrom->mTo);
+    } else {
+        snprintf(buf, sizeof(buf), "%s %s %.*s", range, entry.mPermissions.c_str(), static_cast<int>(name.size()), name.data());
+    }
+    return std::string(buf);
+}
+
+void History::printDiff(const Process& process) {
+    const auto& snapshots = process.snapshots();
+    if (snapshots.empty()) {
+        return;
+    }
+
+    auto lastSnapshot = process.lastSnapshot();
+    auto snapshotAt = [&](int64_t offset) {
+        if (offset >= lastSnapshot->timestamp() - mFirstTimestamp) {
+            return lastSnapshot;
+        }
+        return static_cast<const Snapshot*>(snapshots.lower_bound(mFirstTimestamp + offset)->second);
+    };
+
+    auto fromSnapshot = snapshotAt(mDiffFrom);
+    auto toSnapshot = snapshotAt(mDiffTo);
+    if (fromSnapshot == toSnapshot) {
+        printf("[%d] %s: only one snapshot in the time range\n", process.processId(), process.name().c_str());
+        return;
+    }
+
+    mDiff.compute(*fromSnapshot, *toSnapshot, process.isRollup());
+
+    printf("[%d] %s: %+" PRId64 "kB heap, %+" PRId64 "kB rss from %s to %s\n",
+           process.processId(),
+           process.name().c_str(),
+           mDiff.heapDelta(),
+           mDiff.rssDelta(),
+           formatOffset(fromSnapshot->timestamp() - mFirstTimestamp).c_str(),
+           formatOffset(toSnapshot->timestamp() - mFirstTimestamp).c_str());
+
+    printf("  kinds:\n");
+    for (const auto& kind : mDiff.kinds()) {
+        printf("    %+10" PRId64 "kB heap %+10" PRId64 "kB rss  %.*s (%d mappings)\n",
+               kind.mHeap,
+               kind.mRss,
+               static_cast<int>(kind.mName.size()),
+               kind.mName.data(),
+               kind.mMappings);
+    }
+
+    printf("  top paths:\n");
+    size_t count = 0;
+    for (const auto& path : mDiff.paths()) {
+        if (count == DIFF_TOP_COUNT || (path.mHeap <= 0 && path.mRss <= 0)) {
+            break;
+        }
+        printf("    %+10" PRId64 "kB heap %+10" PRId64 "kB rss  %.*s (%d mappings)\n",
+               path.mHeap,
+               path.mRss,
+               static_cast<int>(path.mName.size()),
+               path.mName.data(),
+               path.mMappings);
+        count++;
+    }
+
+    printf("  top mappings:\n");
+    count = 0;
+    for (const auto& change : mDiff.changes()) {
+        if (count == DIFF_TOP_COUNT || (change.mHeap <= 0 && change.mRss <= 0)) {
+            break;
+        }
+        printf("    %+10" PRId64 "kB heap %+10" PRId64 "kB rss  %s\n",
+               change.mHeap,
+               change.mRss,
+               describeChange(change).c_str());
+        count++;
+    }
+
+    if (!mDiffTimeline) {
+        return;
+    }
+
+    printf("  timeline:\n");
+    for (const auto& step : mTimeline) {
+        if (step.mIdentity != process.identity()
+            || step.mTimestamp <= fromSnapshot->timestamp()
+            || step.mTimestamp > toSnapshot->timestamp()) {
+            continue;
+        }
+        printf("    %12s %+10" PRId64 "kB heap %+10" PRId64 "kB rss  %s %+" PRId64 "kB\n",
+               formatOffset(step.mTimestamp - mFirstTimestamp).c_str(),
+               step.mHeap,
+               step.mRss,
+               step.mTopName.c_str(),
+               step.mTopHeap);
+    }
+}
@@ -1,18 +1,27 @@
 #pragma once
 #include "common.h"
+#include "processidentity.h"
+#include "snapshotdiff.h"
 #include <map>
 #include <stdio.h>
 #include <unistd.h>
 #include <memory>
 #include <string>
+#include <vector>
 
 class Process;
+class ByteReader;
+class MappedFile;
 class Snapshot;
+class ThreadPool;
 
 class History {
 public:
     enum class LoadHint {
         all,
+        // reads every snapshot for the trends, keeps the first and last
+        trend,
+        // only reads the first and last snapshots if there is an index
         firstAndLast,
     };
 
@@ -22,20 +31,155 @@ public:
 
     void setSampleFilePath(const std::string& path);
 
+    // number of threads decoding archives, 1 reads them on this thread
+    void setJobCount(int jobCount);
+
     void load(LoadHint mode);
 
     void summary();
 
     void plot();
 
+    // Loads the archive and prints where the memory of the processes with
+    // this pid grew between their first snapshots at or after from and to,
+    // in milliseconds since the first snapshot of the archive, with
+    // timeline also between every two consecutive snapshots.
+    void diff(pid_t processId, int64_t from, int64_t to, bool timeline);
+
 private:
-    void readSnapshot(FILE* f);
+    // a step of the growth timeline of diff()
+    struct TimelineStep {
+        ProcessIdentity mIdentity;
+        int64_t mTimestamp;
+        int64_t mHeap;
+        int64_t mRss;
+        // the path that grew the most
+        std::string mTopName;
+        int64_t mTopHeap;
+    };
+
+    // keeps the snapshots diff() needs and adds a timeline step, called
+    // before the snapshot becomes the delta base of its process
+    void watchSnapshot(const Snapshot& snapshot);
+
+    void printDiff(const Process& process);
+
+    // frames from a keyframe up to the next chunk, see loadChunks()
+    struct Chunk;
+
+    // reads snapshots until the end of stream, returns false on errors
+    bool readSnapshots(ByteReader& reader, uint32_t version, bool keyframe, LoadHint hint, int& processedSnapshotCount);
+
+    // reads the frame at the position of reader, returns false at the end
+    // or on errors
+    bool readNextFrame(ByteReader& reader, MappedFile& file, std::string& buffer, uint32_t version, LoadHint hint, int& processedSnapshotCount);
+
+    // The part of reading a snapshot that depends on the ones before it,
+    // snapshots have to be added in archive order.
+    void addSnapshot(std::unique_ptr<Snapshot> snapshot, bool killed, LoadHint hint);
+
+    // Decodes the frames from reader on in chunks that start with a
+    // keyframe on the thread pool and adds their snapshots in file order.
+    void loadChunks(ByteReader& reader, MappedFile& file, uint32_t version, LoadHint hint, int& processedSnapshotCount);
+
+    // runs on the thread pool, only touches the chunk
+    static void decodeChunk(Chunk& chunk, const MappedFile& file, uint32_t version);
+
+    // returns false if reading has to stop
+    bool addChunk(Chunk& chunk, MappedFile& file, uint32_t version, LoadHint hint, int& processedSnapshotCount);
+
+    // appends the snapshots collected in mSeriesAppends to the series of
+    // their processes, one process per task
+    void appendSeries();
+
+    // loads one archive or segment, snapshots continue the ones loaded before
+    void loadArchive(const std::string& path, LoadHint hint, int& processedSnapshotCount);
+
+    bool loadFromIndex(const std::string& path, const MappedFile& file, uint32_t version, int& processedSnapshotCount);
+
+    // finds the process of the snapshot or adds a new one
+    Process* processFor(const Snapshot& snapshot);
+
+    // a snapshot to read the next one from reader into, preferably the
+    // recycled one of the same process, which has about the same size
+    std::unique_ptr<Snapshot> newSnapshot(const ByteReader& reader, uint32_t version);
+
+    // keeps the snapshot as spare for the next one of its process
+    void recycleSnapshot(std::unique_ptr<Snapshot> snapshot);
+
+    // makes the snapshot the delta base of its process, the superseded
+    // base is handed to the process if it is its first snapshot or one
+    // diff() needs and recycled otherwise
+    void replaceDeltaBase(std::unique_ptr<Snapshot> snapshot);
+
+    // the delta base of an ended process becomes its last snapshot
+    void endDeltaBase(const ProcessIdentity& identity);
+
+    // ends the delta bases of all processes
+    void addLastSnapshots();
+
+    // Processes that are not in a frame did not change, their trends get
+    // the previous value at the time of the frame. Bases older than the
+    // last keyframe belong to processes that ended without killed marker.
+    void addUnchangedToTrends(bool keyframe);
 
     std::vector<Process*> processesSortedByGrowth();
 
     std::string mSampleFilePath = DEFAULT_SAMPLE_FILE_NAME;
 
-    std::map<pid_t, Process*> mProcesses;
+    std::map<ProcessIdentity, Process*> mProcesses;
+
+    // the snapshot the next one of each process is decoded against, owned
+    // here until it is superseded or the process ends, so memory use
+    // depends on the number of live processes and not on the archive size
+    std::map<ProcessIdentity, std::unique_ptr<Snapshot>> mDeltaBases;
+
+    // at most one per process, see recycleSnapshot()
+    std::map<ProcessIdentity, std::unique_ptr<Snapshot>> mSpareSnapshots;
+
+    // of an ended process, used for the next new one
+    std::unique_ptr<Snapshot> mSpareSnapshot;
+
+    // processes read from the current frame and the time range of their
+    // snapshots
+    std::vector<ProcessIdentity> mFrameIdentities;
+
+    int64_t mFrameStart = 0;
+
+    int64_t mFrameEnd = 0;
+
+    // time of the first snapshot of the last keyframe
+    int64_t mKeyframeTime = 0;
+
+    // time of the first snapshot read
+    int64_t mFirstTimestamp = 0;
+
+    int mJobCount = 1;
+
+    std::unique_ptr<ThreadPool> mThreadPool;
+
+    // While a decoded chunk is added, snapshots are not recycled in place
+    // but collected here and handed to the next chunk to decode. They stay
+    // intact until appendSeries() is done with them.
+    bool mCollectRecycled = false;
+
+    std::vector<std::unique_ptr<Snapshot>> mRecycled;
+
+    std::vector<std::pair<Process*, const Snapshot*>> mSeriesAppends;
+
+    // see diff(), 0 if no process is watched
+    pid_t mDiffProcessId = 0;
+
+    int64_t mDiffFrom = 0;
+
+    int64_t mDiffTo = 0;
+
+    bool mDiffTimeline = false;
+
+    // snapshots that are handed to their process instead of being recycled
+    std::vector<const Snapshot*> mKeptSnapshots;
+
+    std::vector<TimelineStep> mTimeline;
 
-    std::map<pid_t, Snapshot*> mPrevSnapshots;
+    SnapshotDiff mDiff;
 };
@@ -0,0 +1,102 @@
+#include "index.h"
+#include "common.h"
+#include "bytewriter.h"
+#include "sink.h"
+#include <fstream>
+#include <stdio.h>
+
+static constexpr uint32_t INDEX_MAGIC = 0x49484848; // "HHHI"
+
+// version 2: process start times
+static constexpr uint32_t INDEX_VERSION = 2;
+
+static constexpr uint64_t INDEX_HEADER_SIZE = 8;
+
+static uint64_t indexRecordSize(uint32_t version) {
+    return version == 1 ? 28 : 36;
+}
+
+std::string indexFilePath(const std::string& sampleFilePath) {
+    return sampleFilePath + ".index";
+}
+
+bool writeIndexHeader(Sink& sink) {
+    ByteWriter writer;
+    writer.writeUInt32(INDEX_MAGIC);
+    writer.writeUInt32(INDEX_VERSION);
+    return sink.write(writer.data());
+}
+
+bool writeIndexRecords(Sink& sink, const std::vector<IndexRecord>& records) {
+    ByteWriter writer;
+    for (const auto& record : records) {
+        writer.writeUInt32(static_cast<uint32_t>(record.mProcessId));
+        writer.writeUInt64(record.mStartTime);
+        writer.writeInt64(record.mTimestamp);
+        writer.writeUInt64(record.mFrameOffset);
+        writer.writeUInt32(record.mSnapshotOffset);
+        writer.writeUInt32(record.mStandalone ? 1 : 0);
+    }
+    return sink.write(writer.data());
+}
+
+static bool readIndex(const std::string& path, std::vector<IndexRecord>& records, uint32_t& version) {
+    std::ifstream stream(path, std::ifstream::binary | std::ifstream::in);
+    if (!stream.is_open()) {
+        return false;
+    }
+
+    uint32_t magic = 0;
+    readUInt32(stream, magic);
+    readUInt32(stream, version);
+    if (!stream.good() || magic != INDEX_MAGIC || version < 1 || version > INDEX_VERSION) {
+        printf("invalid index file %s\n", path.c_str());
+        return false;
+    }
+
+    while (true) {
+        uint32_t pid = 0;
+        uint32_t standalone = 0;
+        IndexRecord record;
+        readUInt32(stream, pid);
+        if (version >= 2) {
+            readUInt64(stream, record.mStartTime);
+        }
+        readInt64(stream, record.mTimestamp);
+        readUInt64(stream, record.mFrameOffset);
+        readUInt32(stream, record.mSnapshotOffset);
+        readUInt32(stream, standalone);
+        if (!stream.good()) {
+            // end of file or a partially written last record
+            break;
+        }
+
+        record.mProcessId = static_cast<pid_t>(pid);
+        record.mStandalone = standalone != 0;
+        records.push_back(record);
+    }
+
+    return true;
+}
+
+bool readIndex(const std::string& path, std::vector<IndexRecord>& records) {
+    uint32_t version = 0;
+    return readIndex(path, records, version);
+}
+
+bool validIndexSize(const std::string& path, uint64_t archiveSize, uint64_t& size) {
+    std::vector<IndexRecord> records;
+    uint32_t version = 0;
+    if (!readIndex(path, records, version)) {
+        return false;
+    }
+
+    // records are in archive order
+    size_t count = 0;
+    while (count < records.size() && records[count].mFrameOffset < archiveSize) {
+        count++;
+    }
+
+    size = INDEX_HEADER_SIZE + count * indexRecordSize(version);
+    return true;
+}
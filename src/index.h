@@ -0,0 +1,44 @@
+#pragma once
+#include <stdint.h>
+#include <sys/types.h>
+#include <string>
+#include <vector>
+
+class Sink;
+
+// The index file lists every snapshot of an archive with the position of
+// its frame, so single processes can be decoded without reading the whole
+// archive. It is appended to after each frame and may lag behind the
+// archive after a crash.
+struct IndexRecord {
+    pid_t mProcessId = 0;
+
+    // 0 in indexes written before version 2
+    uint64_t mStartTime = 0;
+
+    // in the unit of the archive, see ARCHIVE_VERSION
+    int64_t mTimestamp = 0;
+
+    // file offset of the frame containing the snapshot
+    uint64_t mFrameOffset = 0;
+
+    // offset of the snapshot in the decompressed frame
+    uint32_t mSnapshotOffset = 0;
+
+    // the snapshot was written without delta base
+    bool mStandalone = false;
+};
+
+std::string indexFilePath(const std::string& sampleFilePath);
+
+bool writeIndexHeader(Sink& sink);
+
+// writes all records at once
+bool writeIndexRecords(Sink& sink, const std::vector<IndexRecord>& records);
+
+// size of the index file without the records of frames at or behind
+// archiveSize, returns false if the file is missing or invalid
+bool validIndexSize(const std::string& path, uint64_t archiveSize, uint64_t& size);
+
+// reads all complete records, returns false if the file is missing or invalid
+bool readIndex(const std::string& path, std::vector<IndexRecord>& records);
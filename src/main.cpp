@@ -1,11 +1,15 @@
 #include "recorder.h"
 #include "history.h"
 #include "common.h"
+#include "frame.h"
+#include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 #include <string>
 #include <vector>
 #include <optional>
 #include <chrono>
+#include <limits>
 
 void printHelp() {
     printf("usage: %s <command> [<args>]\n", APP_NAME);
@@ -14,6 +18,7 @@ void printHelp() {
     printf("\n");
     printf("  record   Start recording memory samples\n");
     printf("  summary  Shows the summary of a sampling session\n");
+    printf("  diff     Shows where the memory of a process grew\n");
     printf("\n");
 }
 
@@ -24,13 +29,57 @@ void printRecordHelp() {
     printf("  --sample-file=<path>\n");
     printf("    Set path to sample file.\n");
     printf("  --sample-interval=<interval>\n");
-    printf("    Set sampling interval in seconds(default=%d).\n", static_cast<int>(DEFAULT_SAMPLING_INTERVAL.count()));
+    printf("    Set sampling interval in seconds, fractions or ms are allowed\n");
+    printf("    for short reproductions, e.g. 0.5 or 250ms (default=%d).\n", static_cast<int>(DEFAULT_SAMPLING_INTERVAL.count() / 1000));
     printf("  --sample-count=<count>\n");
     printf("    The number of samples to collect.\n");
+    printf("  --append\n");
+    printf("    Continue an existing sample file instead of replacing it.\n");
+    printf("  --rotate=<duration>\n");
+    printf("    Start a new segment <sample-file>.<time> after this time, e.g. 30m\n");
+    printf("    or 1h. Summary and plot accept the sample file path of a rotated\n");
+    printf("    recording, a directory or a glob pattern of segments.\n");
+    printf("  --max-disk=<size>\n");
+    printf("    With --rotate, remove the oldest segments when all of them take\n");
+    printf("    more than this, e.g. 500M or 2G. Checked after every sweep, a\n");
+    printf("    segment that alone exceeds it is rotated early.\n");
+    printf("  --max-sample-interval=<interval>\n");
+    printf("    Sample processes that do not change less often, down to once per\n");
+    printf("    this interval. Growing processes are sampled every interval.\n");
+    printf("  --cpu-budget=<percent>\n");
+    printf("    Limit the time spent taking snapshots to this share of the sampling\n");
+    printf("    interval, the fastest growing processes are sampled first.\n");
+    printf("  --precheck-tolerance=<kB>\n");
+    printf("    Only read smaps of processes whose resident or data size in statm\n");
+    printf("    moved by more than this since their last snapshot (off by default).\n");
+    printf("  --max-staleness=<interval>\n");
+    printf("    With --precheck-tolerance, read smaps at least this often (default=10m).\n");
+    printf("  --jobs=<count>\n");
+    printf("    Number of processes to sample in parallel (default=1).\n");
+    printf("  --compression=<none|zlib>\n");
+    printf("    Compression of the sample file (default=%s).\n", defaultCompression() == Compression::zlib ? "zlib" : "none");
+    printf("  --keyframe-interval=<sweeps>\n");
+    printf("    Write all processes without delta every <sweeps> sweeps (default=%d).\n", DEFAULT_KEYFRAME_INTERVAL);
+    printf("  --mode=<full|rollup>\n");
+    printf("    Record every mapping (full, default) or per process totals\n");
+    printf("    from smaps_rollup (rollup).\n");
+    printf("  --rollup-threshold=<kB>\n");
+    printf("    In rollup mode, record full smaps for processes whose heap grew\n");
+    printf("    by more than this (default=%d, 0 disables).\n", static_cast<int>(DEFAULT_ROLLUP_UPGRADE_THRESHOLD));
     printf("  --include=<regexp>\n");
-    printf("    Regexp describing the processes to include.\n");
+    printf("    Regexp describing the command lines of the processes to include.\n");
     printf("  --exclude=<regexp>\n");
-    printf("    Regexp describing the processes to exclude.\n");
+    printf("    Regexp describing the command lines of the processes to exclude.\n");
+    printf("  --comm=<name>\n");
+    printf("    Only record processes with this name (/proc/<pid>/comm).\n");
+    printf("  --uid=<uid>\n");
+    printf("    Only record processes of this user.\n");
+    printf("  --cgroup=<path>\n");
+    printf("    Only record processes in this cgroup or below, e.g. /system.slice.\n");
+    printf("  --min-rss=<kB>\n");
+    printf("    Only record processes with at least this resident set size.\n");
+    printf("  Filters can be given more than once, a process has to match one\n");
+    printf("  value of every kind of filter given.\n");
 }
 
 void printSummaryHelp() {
@@ -38,7 +87,12 @@ void printSummaryHelp() {
     printf("\n");
     printf("options:\n");
     printf("  --sample-file=<path>\n");
-    printf("    The path the the sample-file.\n");
+    printf("    The path the the sample-file, a directory or a glob pattern of segments.\n");
+    printf("  --quick\n");
+    printf("    Only compare the first and last snapshot of every process using the\n");
+    printf("    index instead of reading all snapshots for the heap trends.\n");
+    printf("  --jobs=<count>\n");
+    printf("    Number of threads reading the sample file (default=number of cores).\n");
 }
 
 void printPlotHelp() {
@@ -46,7 +100,28 @@ void printPlotHelp() {
     printf("\n");
     printf("options:\n");
     printf("  --sample-file=<path>\n");
-    printf("    The path the the sample-file.\n");
+    printf("    The path the the sample-file, a directory or a glob pattern of segments.\n");
+    printf("  --jobs=<count>\n");
+    printf("    Number of threads reading the sample file (default=number of cores).\n");
+}
+
+void printDiffHelp() {
+    printf("usage: %s diff --pid=<pid> [<args>]\n", APP_NAME);
+    printf("\n");
+    printf("options:\n");
+    printf("  --sample-file=<path>\n");
+    printf("    The path the the sample-file, a directory or a glob pattern of segments.\n");
+    printf("  --pid=<pid>\n");
+    printf("    The process to compare.\n");
+    printf("  --from=<time>\n");
+    printf("  --to=<time>\n");
+    printf("    Compare the first snapshots at or after these times since the start\n");
+    printf("    of the recording, e.g. 90s or 2h (default=first and last snapshot).\n");
+    printf("  --timeline\n");
+    printf("    Also show the heap change and the path that changed the most\n");
+    printf("    between every two consecutive snapshots.\n");
+    printf("  --jobs=<count>\n");
+    printf("    Number of threads reading the sample file (default=number of cores).\n");
 }
 
 void showErrorAndExit(const std::string& value) {
@@ -123,6 +198,55 @@ std::optional<int32_t> tryToGetOptionInt32Option(char shortOption,
     return atoi(value->c_str());
 }
 
+// seconds ("90", "0.5", "90s") or a number with one of the units ms, m, h or d
+std::optional<std::chrono::milliseconds> parseDuration(const std::string& value) {
+    char* end = nullptr;
+    auto number = strtod(value.c_str(), &end);
+    if (end == value.c_str() || number < 0) {
+        return {};
+    }
+
+    double milliseconds;
+    std::string unit(end);
+    if (unit.empty() || unit == "s") {
+        milliseconds = number * 1000;
+    } else if (unit == "ms") {
+        milliseconds = number;
+    } else if (unit == "m") {
+        milliseconds = number * 60 * 1000;
+    } else if (unit == "h") {
+        milliseconds = number * 3600 * 1000;
+    } else if (unit == "d") {
+        milliseconds = number * 24 * 3600 * 1000;
+    } else {
+        return {};
+    }
+
+    return std::chrono::milliseconds(static_cast<int64_t>(milliseconds + 0.5));
+}
+
+// bytes with an optional binary K, M, G or T suffix
+std::optional<uint64_t> parseSize(const std::string& value) {
+    char* end = nullptr;
+    auto number = strtoull(value.c_str(), &end, 10);
+    if (end == value.c_str() || value[0] == '-') {
+        return {};
+    }
+
+    std::string unit(end);
+    if (unit.empty()) {
+        return number;
+    }
+
+    const std::string units = "KMGT";
+    auto pos = units.find(static_cast<char>(toupper(unit[0])));
+    if (pos == std::string::npos || unit.size() > 1) {
+        return {};
+    }
+
+    return number << (10 * (pos + 1));
+}
+
 static std::string sampleFilePath;
 
 void cmdHelp(const std::vector<std::string>& args) {
@@ -132,6 +256,8 @@ void cmdHelp(const std::vector<std::string>& args) {
         printRecordHelp();
     } else if (args[0] == "summary") {
         printSummaryHelp();
+    } else if (args[0] == "diff") {
+        printDiffHelp();
     } else {
         printHelp();
     }
@@ -140,6 +266,7 @@ void cmdHelp(const std::vector<std::string>& args) {
 void cmdRecord(const std::vector<std::string>& args) {
 
     Recorder recorder;
+    ProcessFilter filter;
 
     for (size_t i = 0; i < args.size(); i++) {
         if (tryToGetSwitchOption('h', "help", args, i)) {
@@ -153,9 +280,38 @@ void cmdRecord(const std::vector<std::string>& args) {
             continue;
         }
 
-        auto sampleInterval = tryToGetOptionInt32Option('\0', "sample-interval", args, i);
+        if (tryToGetSwitchOption('\0', "append", args, i)) {
+            recorder.setAppend(true);
+            continue;
+        }
+
+        auto sampleInterval = tryToGetStringOption('\0', "sample-interval", args, i);
         if (sampleInterval) {
-            recorder.setSampleInterval(std::chrono::seconds(*sampleInterval));
+            auto interval = parseDuration(*sampleInterval);
+            if (!interval) {
+                showErrorAndExit(std::string("invalid sample interval ") + *sampleInterval);
+            }
+            recorder.setSampleInterval(*interval);
+            continue;
+        }
+
+        auto rotate = tryToGetStringOption('\0', "rotate", args, i);
+        if (rotate) {
+            auto interval = parseDuration(*rotate);
+            if (!interval) {
+                showErrorAndExit(std::string("invalid rotate interval ") + *rotate);
+            }
+            recorder.setRotateInterval(std::chrono::duration_cast<std::chrono::seconds>(*interval));
+            continue;
+        }
+
+        auto maxDisk = tryToGetStringOption('\0', "max-disk", args, i);
+        if (maxDisk) {
+            auto size = parseSize(*maxDisk);
+            if (!size) {
+                showErrorAndExit(std::string("invalid disk size ") + *maxDisk);
+            }
+            recorder.setMaxDiskUsage(*size);
             continue;
         }
 
@@ -165,19 +321,131 @@ void cmdRecord(const std::vector<std::string>& args) {
             continue;
         }
 
-        auto includeExp = tryToGetStringOption('\0', "include-exp", args, i);
-        if (includeExp) {
+        auto maxSampleInterval = tryToGetStringOption('\0', "max-sample-interval", args, i);
+        if (maxSampleInterval) {
+            auto interval = parseDuration(*maxSampleInterval);
+            if (!interval) {
+                showErrorAndExit(std::string("invalid sample interval ") + *maxSampleInterval);
+            }
+            recorder.setMaxSampleInterval(*interval);
+            continue;
+        }
+
+        auto cpuBudget = tryToGetOptionInt32Option('\0', "cpu-budget", args, i);
+        if (cpuBudget) {
+            recorder.setCpuBudget(*cpuBudget);
+            continue;
+        }
+
+        auto precheckTolerance = tryToGetOptionInt32Option('\0', "precheck-tolerance", args, i);
+        if (precheckTolerance) {
+            recorder.setPrecheckTolerance(*precheckTolerance);
+            continue;
+        }
+
+        auto maxStaleness = tryToGetStringOption('\0', "max-staleness", args, i);
+        if (maxStaleness) {
+            auto interval = parseDuration(*maxStaleness);
+            if (!interval) {
+                showErrorAndExit(std::string("invalid staleness ") + *maxStaleness);
+            }
+            recorder.setMaxStaleness(*interval);
+            continue;
+        }
+
+        auto jobCount = tryToGetOptionInt32Option('j', "jobs", args, i);
+        if (jobCount) {
+            recorder.setJobCount(*jobCount);
             continue;
         }
 
-        auto excludeExp = tryToGetStringOption('\0', "exclude-exp", args, i);
-        if (excludeExp) {
+        auto compressionName = tryToGetStringOption('\0', "compression", args, i);
+        if (compressionName) {
+            auto compression = compressionFromString(*compressionName);
+            if (!compression) {
+                showErrorAndExit(std::string("invalid compression ") + *compressionName);
+            }
+            if (!isCompressionSupported(*compression)) {
+                showErrorAndExit(std::string("compression not supported by this build: ") + *compressionName);
+            }
+            recorder.setCompression(*compression);
+            continue;
+        }
+
+        auto keyframeInterval = tryToGetOptionInt32Option('\0', "keyframe-interval", args, i);
+        if (keyframeInterval) {
+            recorder.setKeyframeInterval(*keyframeInterval);
+            continue;
+        }
+
+        auto mode = tryToGetStringOption('\0', "mode", args, i);
+        if (mode) {
+            if (*mode == "full") {
+                recorder.setMode(Recorder::Mode::full);
+            } else if (*mode == "rollup") {
+                recorder.setMode(Recorder::Mode::rollup);
+            } else {
+                showErrorAndExit(std::string("invalid mode ") + *mode);
+            }
+            continue;
+        }
+
+        auto rollupThreshold = tryToGetOptionInt32Option('\0', "rollup-threshold", args, i);
+        if (rollupThreshold) {
+            recorder.setRollupUpgradeThreshold(*rollupThreshold);
+            continue;
+        }
+
+        auto include = tryToGetStringOption('\0', "include", args, i);
+        if (!include) {
+            include = tryToGetStringOption('\0', "include-exp", args, i);
+        }
+        if (include) {
+            if (!filter.addInclude(*include)) {
+                showErrorAndExit(std::string("invalid regexp ") + *include);
+            }
+            continue;
+        }
+
+        auto exclude = tryToGetStringOption('\0', "exclude", args, i);
+        if (!exclude) {
+            exclude = tryToGetStringOption('\0', "exclude-exp", args, i);
+        }
+        if (exclude) {
+            if (!filter.addExclude(*exclude)) {
+                showErrorAndExit(std::string("invalid regexp ") + *exclude);
+            }
+            continue;
+        }
+
+        auto comm = tryToGetStringOption('\0', "comm", args, i);
+        if (comm) {
+            filter.addComm(*comm);
+            continue;
+        }
+
+        auto uid = tryToGetOptionInt32Option('\0', "uid", args, i);
+        if (uid) {
+            filter.addUid(static_cast<uid_t>(*uid));
+            continue;
+        }
+
+        auto cgroup = tryToGetStringOption('\0', "cgroup", args, i);
+        if (cgroup) {
+            filter.addCgroup(*cgroup);
+            continue;
+        }
+
+        auto minRss = tryToGetOptionInt32Option('\0', "min-rss", args, i);
+        if (minRss) {
+            filter.setMinRss(*minRss);
             continue;
         }
 
         showErrorAndExit(std::string("invalid option ") + args[i]);
     }
 
+    recorder.setProcessFilter(std::move(filter));
     recorder.record();
 
 }
@@ -185,6 +453,7 @@ void cmdRecord(const std::vector<std::string>& args) {
 void cmdSummary(const std::vector<std::string>& args) {
 
     History history;
+    bool quick = false;
 
     for (size_t i = 0; i < args.size(); i++) {
 
@@ -193,9 +462,20 @@ void cmdSummary(const std::vector<std::string>& args) {
             history.setSampleFilePath(*sampleFile);
             continue;
         }
+
+        auto jobs = tryToGetOptionInt32Option('\0', "jobs", args, i);
+        if (jobs) {
+            history.setJobCount(*jobs);
+            continue;
+        }
+
+        if (tryToGetSwitchOption('\0', "quick", args, i)) {
+            quick = true;
+            continue;
+        }
     }
 
-    history.load(History::LoadHint::firstAndLast);
+    history.load(quick ? History::LoadHint::firstAndLast : History::LoadHint::trend);
     history.summary();
 }
 
@@ -209,12 +489,84 @@ void cmdPlot(const std::vector<std::string>& args) {
             history.setSampleFilePath(*sampleFile);
             continue;
         }
+
+        auto jobs = tryToGetOptionInt32Option('\0', "jobs", args, i);
+        if (jobs) {
+            history.setJobCount(*jobs);
+            continue;
+        }
     }
 
     history.load(History::LoadHint::all);
     history.plot();
 }
 
+void cmdDiff(const std::vector<std::string>& args) {
+    History history;
+    pid_t processId = 0;
+    int64_t from = 0;
+    int64_t to = std::numeric_limits<int64_t>::max();
+    bool timeline = false;
+
+    for (size_t i = 0; i < args.size(); i++) {
+
+        auto sampleFile = tryToGetStringOption('\0', "sample-file", args, i);
+        if (sampleFile) {
+            history.setSampleFilePath(*sampleFile);
+            continue;
+        }
+
+        auto pid = tryToGetOptionInt32Option('\0', "pid", args, i);
+        if (pid) {
+            processId = static_cast<pid_t>(*pid);
+            continue;
+        }
+
+        auto fromValue = tryToGetStringOption('\0', "from", args, i);
+        if (fromValue) {
+            auto time = parseDuration(*fromValue);
+            if (!time) {
+                showErrorAndExit(std::string("invalid time ") + *fromValue);
+            }
+            from = time->count();
+            continue;
+        }
+
+        auto toValue = tryToGetStringOption('\0', "to", args, i);
+        if (toValue) {
+            auto time = parseDuration(*toValue);
+            if (!time) {
+                showErrorAndExit(std::string("invalid time ") + *toValue);
+            }
+            to = time->count();
+            continue;
+        }
+
+        auto jobs = tryToGetOptionInt32Option('\0', "jobs", args, i);
+        if (jobs) {
+            history.setJobCount(*jobs);
+            continue;
+        }
+
+        if (tryToGetSwitchOption('\0', "timeline", args, i)) {
+            timeline = true;
+            continue;
+        }
+
+        showErrorAndExit(std::string("invalid option ") + args[i]);
+    }
+
+    if (processId <= 0) {
+        showErrorAndExit("missing --pid");
+    }
+
+    if (from > to) {
+        showErrorAndExit("--from is after --to");
+    }
+
+    history.diff(processId, from, to, timeline);
+}
+
 int main(int argc, char* argv[]) {
     std::vector<std::string> args;
     for (int i = 1; i < argc; i++) {
@@ -231,6 +583,8 @@ int main(int argc, char* argv[]) {
         cmdRecord(std::vector<std::string>(args.begin() +1 , args.end()));
     } else if (command == "summary") {
         cmdSummary(std::vector<std::string>(args.begin() +1 , args.end()));
+    } else if (command == "diff") {
+        cmdDiff(std::vector<std::string>(args.begin() +1 , args.end()));
     } else if (command == "plot") {
         cmdPlot(std::vector<std::string>(args.begin() +1 , args.end()));
     } else if (command == "help") {
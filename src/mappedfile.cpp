@@ -0,0 +1,84 @@
+#include "mappedfile.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+void MappedFile::close() {
+    if (mMapped) {
+        munmap(const_cast<char*>(mData), mSize);
+    }
+
+    mData = nullptr;
+    mSize = 0;
+    mMapped = false;
+    mReleased = 0;
+    mBuffer.clear();
+}
+
+void MappedFile::release(size_t offset) {
+    // released in steps, not with every small frame
+    static constexpr size_t RELEASE_STEP = 1024 * 1024;
+
+    if (!mMapped || offset > mSize) {
+        return;
+    }
+
+    auto pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    auto end = offset / pageSize * pageSize;
+    if (end < mReleased + RELEASE_STEP) {
+        return;
+    }
+
+    madvise(const_cast<char*>(mData) + mReleased, end - mReleased, MADV_DONTNEED);
+    mReleased = end;
+}
+
+bool MappedFile::open(const std::string& path) {
+    close();
+
+    auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        auto data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            ::close(fd);
+            mData = static_cast<const char*>(data);
+            mSize = static_cast<size_t>(st.st_size);
+            mMapped = true;
+            return true;
+        }
+    }
+
+    char buf[64 * 1024];
+    while (true) {
+        auto rd = read(fd, buf, sizeof(buf));
+        if (rd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            printf("failed to read %s (errno=%d)\n", path.c_str(), errno);
+            ::close(fd);
+            return false;
+        }
+        if (rd == 0) {
+            break;
+        }
+        mBuffer.append(buf, static_cast<size_t>(rd));
+    }
+
+    ::close(fd);
+    mData = mBuffer.data();
+    mSize = mBuffer.size();
+    return true;
+}
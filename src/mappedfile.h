@@ -0,0 +1,44 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <string_view>
+
+// Read only memory mapping of a whole file. Files that cannot be mapped
+// (e.g. pipes) are read into memory instead.
+class MappedFile {
+public:
+    MappedFile() = default;
+
+    ~MappedFile();
+
+    bool open(const std::string& path);
+
+    const char* data() const { return mData; }
+
+    size_t size() const { return mSize; }
+
+    std::string_view view() const { return std::string_view(mData, mSize); }
+
+    // The content before offset will not be read again. Its pages are
+    // dropped from the mapping, so reading a large file front to back does
+    // not keep all of it resident. The file stays readable.
+    void release(size_t offset);
+
+private:
+    MappedFile(const MappedFile&) = delete;
+    void operator= (const MappedFile&) = delete;
+
+    void close();
+
+    const char* mData = nullptr;
+
+    size_t mSize = 0;
+
+    bool mMapped = false;
+
+    // end of the released part, page aligned
+    size_t mReleased = 0;
+
+    // holds the content if the file could not be mapped
+    std::string mBuffer;
+};
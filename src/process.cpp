@@ -1,9 +1,11 @@
 #include "process.h"
 #include "snapshot.h"
 
-Process::Process(pid_t processId, const std::string& name) {
-    mProcessId = processId;
+Process::Process(const ProcessIdentity& identity, const std::string& name, bool rollup) {
+    mProcessId = identity.mProcessId;
+    mStartTime = identity.mStartTime;
     mName = name;
+    mRollup = rollup;
 
     auto end = name.find(' ');
     mShortName = name.substr(0, end);
@@ -15,6 +17,13 @@ Process::~Process() {
     }
 }
 
+int64_t Process::heapUsage(const Snapshot& snapshot) const {
+    if (mRollup) {
+        return snapshot.usage().mAnonymous;
+    }
+    return snapshot.heapUsage();
+}
+
 void Process::addSnapshot(Snapshot* snapshot) {
     mSnapshots[snapshot->timestamp()] = snapshot;
 }
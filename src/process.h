@@ -1,5 +1,8 @@
 #pragma once
 #include "entry.h"
+#include "processidentity.h"
+#include "timeseries.h"
+#include "trend.h"
 #include <map>
 #include <string>
 
@@ -7,30 +10,62 @@ class Snapshot;
 
 class Process {
 public:
-    Process(pid_t processId, const std::string& name);
+    // rollup if the first snapshot of the process is from smaps_rollup
+    Process(const ProcessIdentity& identity, const std::string& name, bool rollup);
 
     ~Process();
 
     pid_t processId() const { return mProcessId; }
 
+    uint64_t startTime() const { return mStartTime; }
+
+    ProcessIdentity identity() const { return {mProcessId, mStartTime}; }
+
     const std::string& name() const { return mName; }
 
     const std::string& shortName() const { return mShortName; }
 
+    bool isRollup() const { return mRollup; }
+
+    // Snapshot::heapUsage(), except for processes recorded from
+    // smaps_rollup: those count the anonymous memory of all mappings,
+    // which is what the rollup entry holds, so their series does not jump
+    // when they are upgraded to full smaps
+    int64_t heapUsage(const Snapshot& snapshot) const;
+
     void addSnapshot(Snapshot* snapshot);
 
-    const std::map<time_t, Snapshot*>& snapshots() const { return mSnapshots; }
+    const std::map<int64_t, Snapshot*>& snapshots() const { return mSnapshots; }
 
     const Snapshot* firstSnapshot() const;
 
     const Snapshot* lastSnapshot() const;
 
+    // all loaded snapshots, only filled with History::LoadHint::all
+    TimeSeries& series() { return mSeries; }
+
+    const TimeSeries& series() const { return mSeries; }
+
+    // heap usage of all snapshots read in order, empty if the snapshots
+    // were picked from the index
+    Trend& heapTrend() { return mHeapTrend; }
+
+    const Trend& heapTrend() const { return mHeapTrend; }
+
 private:
     pid_t mProcessId;
 
+    uint64_t mStartTime;
+
     std::string mName;
 
     std::string mShortName;
 
-    std::map<time_t, Snapshot*> mSnapshots;
+    bool mRollup;
+
+    std::map<int64_t, Snapshot*> mSnapshots;
+
+    TimeSeries mSeries;
+
+    Trend mHeapTrend;
 };
@@ -0,0 +1,176 @@
+#include "processfilter.h"
+#include "procfs.h"
+#include <algorithm>
+
+static bool compile(const std::string& expression, std::vector<std::regex>& regexes) {
+    try {
+        regexes.emplace_back(expression, std::regex::extended | std::regex::nosubs | std::regex::optimize);
+    } catch (const std::regex_error&) {
+        return false;
+    }
+    return true;
+}
+
+bool ProcessFilter::addInclude(const std::string& expression) {
+    return compile(expression, mIncludes);
+}
+
+bool ProcessFilter::addExclude(const std::string& expression) {
+    return compile(expression, mExcludes);
+}
+
+void ProcessFilter::addComm(const std::string& comm) {
+    mComms.push_back(comm);
+}
+
+void ProcessFilter::addUid(uid_t uid) {
+    mUids.push_back(uid);
+}
+
+void ProcessFilter::addCgroup(const std::string& cgroup) {
+    mCgroups.push_back(cgroup);
+}
+
+void ProcessFilter::setMinRss(int64_t minRss) {
+    mMinRss = minRss;
+}
+
+bool ProcessFilter::isEmpty() const {
+    return mIncludes.empty()
+        && mExcludes.empty()
+        && mComms.empty()
+        && mUids.empty()
+        && mCgroups.empty()
+        && mMinRss <= 0;
+}
+
+// everything that does not change while a process runs one executable
+bool ProcessFilter::matches(pid_t pid) const {
+    if (!mIncludes.empty() || !mExcludes.empty()) {
+        std::string cmdline;
+        if (!readProcFile(pid, "cmdline", cmdline)) {
+            return false;
+        }
+        std::replace(cmdline.begin(), cmdline.end(), '\0', ' ');
+        while (!cmdline.empty() && cmdline.back() == ' ') {
+            cmdline.pop_back();
+        }
+
+        if (!mIncludes.empty()
+            && std::none_of(mIncludes.begin(), mIncludes.end(), [&](const std::regex& regex) {
+                   return std::regex_search(cmdline, regex);
+               })) {
+            return false;
+        }
+
+        if (std::any_of(mExcludes.begin(), mExcludes.end(), [&](const std::regex& regex) {
+                return std::regex_search(cmdline, regex);
+            })) {
+            return false;
+        }
+    }
+
+    if (!mComms.empty()) {
+        std::string comm;
+        if (!readProcFile(pid, "comm", comm)) {
+            return false;
+        }
+        if (!comm.empty() && comm.back() == '\n') {
+            comm.pop_back();
+        }
+        if (std::find(mComms.begin(), mComms.end(), comm) == mComms.end()) {
+            return false;
+        }
+    }
+
+    if (!mUids.empty()) {
+        uid_t uid;
+        if (!readUid(pid, uid) || std::find(mUids.begin(), mUids.end(), uid) == mUids.end()) {
+            return false;
+        }
+    }
+
+    if (!mCgroups.empty()) {
+        std::string cgroups;
+        if (!readProcFile(pid, "cgroup", cgroups)) {
+            return false;
+        }
+
+        // lines look like "0::/system.slice/foo.service"
+        bool found = false;
+        size_t pos = 0;
+        while (!found && pos < cgroups.size()) {
+            auto end = cgroups.find('\n', pos);
+            if (end == std::string::npos) {
+                end = cgroups.size();
+            }
+            auto line = std::string_view(cgroups).substr(pos, end - pos);
+            pos = end + 1;
+
+            auto colon = line.find(':', line.find(':') + 1);
+            if (colon == std::string_view::npos) {
+                continue;
+            }
+            auto path = line.substr(colon + 1);
+            for (const auto& cgroup : mCgroups) {
+                if (path.compare(0, cgroup.size(), cgroup) == 0) {
+                    found = true;
+                }
+            }
+        }
+        if (!found) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+std::vector<pid_t> ProcessFilter::apply(const std::vector<pid_t>& pids) {
+    if (isEmpty()) {
+        return pids;
+    }
+
+    bool cacheable = !mIncludes.empty() || !mExcludes.empty() || !mComms.empty() || !mUids.empty() || !mCgroups.empty();
+
+    std::map<pid_t, CachedResult> cache;
+    std::vector<pid_t> result;
+    for (auto pid : pids) {
+        bool matches = true;
+        if (cacheable) {
+            CachedResult cached;
+            if (!readStartTime(pid, cached.mStartTime)) {
+                // gone already
+                continue;
+            }
+
+            readExecutable(pid, cached.mExecutableDevice, cached.mExecutableInode);
+
+            auto it = mCache.find(pid);
+            if (it != mCache.end()
+                && it->second.mStartTime == cached.mStartTime
+                && it->second.mExecutableDevice == cached.mExecutableDevice
+                && it->second.mExecutableInode == cached.mExecutableInode) {
+                cached.mMatches = it->second.mMatches;
+            } else {
+                cached.mMatches = this->matches(pid);
+            }
+            matches = cached.mMatches;
+            cache[pid] = cached;
+        }
+
+        // the RSS changes, so it is checked every sweep
+        if (matches && mMinRss > 0) {
+            Statm statm;
+            matches = readStatm(pid, statm) && statm.mResident >= mMinRss;
+        }
+
+        if (matches) {
+            result.push_back(pid);
+        }
+    }
+
+    // drops the processes that ended
+    mCache = std::move(cache);
+    return result;
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <stdint.h>
+#include <sys/types.h>
+#include <map>
+#include <optional>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Decides which processes are recorded, from the small files in
+// /proc/<pid> instead of smaps. Everything but the RSS is evaluated once
+// per process and cached until the pid goes away, is reused or execs.
+class ProcessFilter {
+public:
+    // regexp searched in the command line, arguments separated by spaces
+    bool addInclude(const std::string& expression);
+
+    bool addExclude(const std::string& expression);
+
+    // exact match of /proc/<pid>/comm
+    void addComm(const std::string& comm);
+
+    // real user id
+    void addUid(uid_t uid);
+
+    // prefix of a cgroup path from /proc/<pid>/cgroup
+    void addCgroup(const std::string& cgroup);
+
+    void setMinRss(int64_t minRss);
+
+    bool isEmpty() const;
+
+    // returns the pids that pass the filter, pids is in ascending order
+    std::vector<pid_t> apply(const std::vector<pid_t>& pids);
+
+private:
+    bool matches(pid_t pid) const;
+
+    std::vector<std::regex> mIncludes;
+
+    std::vector<std::regex> mExcludes;
+
+    std::vector<std::string> mComms;
+
+    std::vector<uid_t> mUids;
+
+    std::vector<std::string> mCgroups;
+
+    // kB
+    int64_t mMinRss = 0;
+
+    struct CachedResult {
+        // start time from /proc/<pid>/stat, tells reused pids apart
+        uint64_t mStartTime = 0;
+
+        // executable, tells a process apart from what it was before
+        // execve(), which keeps the start time; 0 if it cannot be read
+        uint64_t mExecutableDevice = 0;
+        uint64_t mExecutableInode = 0;
+
+        bool mMatches = false;
+    };
+
+    std::map<pid_t, CachedResult> mCache;
+};
@@ -0,0 +1,25 @@
+#pragma once
+#include <stdint.h>
+#include <sys/types.h>
+#include <tuple>
+
+// Pids are reused, the start time tells processes with the same pid apart.
+// Archives before version 6 have no start times, all of them are 0.
+struct ProcessIdentity {
+    pid_t mProcessId = 0;
+
+    // clock ticks after boot, see readStartTime()
+    uint64_t mStartTime = 0;
+
+    bool operator < (const ProcessIdentity& other) const {
+        return std::tie(mProcessId, mStartTime) < std::tie(other.mProcessId, other.mStartTime);
+    }
+
+    bool operator == (const ProcessIdentity& other) const {
+        return mProcessId == other.mProcessId && mStartTime == other.mStartTime;
+    }
+
+    bool operator != (const ProcessIdentity& other) const {
+        return !(*this == other);
+    }
+};
@@ -0,0 +1,116 @@
+#include "procfs.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+bool readProcFile(pid_t pid, const char* name, std::string& content) {
+    char path[128];
+    snprintf(path, sizeof(path), "/proc/%d/%s", pid, name);
+
+    // plain read(), fopen() would allocate with every call
+    auto fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    content.clear();
+    char buf[4096];
+    while (true) {
+        auto rd = read(fd, buf, sizeof(buf));
+        if (rd < 0 && errno == EINTR) {
+            continue;
+        }
+        if (rd <= 0) {
+            break;
+        }
+        content.append(buf, static_cast<size_t>(rd));
+    }
+
+    close(fd);
+    return true;
+}
+
+// field 22, counted after the comm in parentheses, which may contain spaces
+bool readStartTime(pid_t pid, uint64_t& startTime) {
+    // kept, so that reading does not allocate after the first call
+    static thread_local std::string stat;
+    if (!readProcFile(pid, "stat", stat)) {
+        return false;
+    }
+
+    auto pos = stat.rfind(')');
+    if (pos == std::string::npos) {
+        return false;
+    }
+
+    // state is field 3
+    int field = 2;
+    const char* p = stat.c_str() + pos + 1;
+    while (*p && field < 22) {
+        while (*p == ' ') {
+            p++;
+        }
+        field++;
+        if (field == 22) {
+            startTime = strtoull(p, nullptr, 10);
+            return true;
+        }
+        while (*p && *p != ' ') {
+            p++;
+        }
+    }
+
+    return false;
+}
+
+bool readExecutable(pid_t pid, uint64_t& device, uint64_t& inode) {
+    char path[128];
+    snprintf(path, sizeof(path), "/proc/%d/exe", pid);
+
+    // stat() follows the link, so the target does not have to be read
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        return false;
+    }
+
+    device = st.st_dev;
+    inode = st.st_ino;
+    return true;
+}
+
+bool readUid(pid_t pid, uid_t& uid) {
+    static thread_local std::string status;
+    if (!readProcFile(pid, "status", status)) {
+        return false;
+    }
+
+    auto pos = status.find("\nUid:");
+    if (pos == std::string::npos) {
+        return false;
+    }
+
+    uid = static_cast<uid_t>(strtoul(status.c_str() + pos + 5, nullptr, 10));
+    return true;
+}
+
+bool readStatm(pid_t pid, Statm& statm) {
+    static thread_local std::string content;
+    if (!readProcFile(pid, "statm", content)) {
+        return false;
+    }
+
+    // size resident shared text lib data dt, in pages
+    unsigned long long values[6];
+    if (sscanf(content.c_str(), "%llu %llu %llu %llu %llu %llu",
+               &values[0], &values[1], &values[2], &values[3], &values[4], &values[5]) != 6) {
+        return false;
+    }
+
+    static const int64_t pageSize = sysconf(_SC_PAGESIZE) / 1024;
+    statm.mResident = static_cast<int64_t>(values[1]) * pageSize;
+    statm.mData = static_cast<int64_t>(values[5]) * pageSize;
+    return true;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <stdint.h>
+#include <sys/types.h>
+#include <string>
+
+// Readers for the small files in /proc/<pid>. All of them return false if
+// the process is gone.
+
+bool readProcFile(pid_t pid, const char* name, std::string& content);
+
+// start time of the process in clock ticks after boot from
+// /proc/<pid>/stat, together with the pid it identifies a process
+bool readStartTime(pid_t pid, uint64_t& startTime);
+
+// device and inode of the executable that /proc/<pid>/exe points to, they
+// change with execve(), also false for kernel threads and processes that
+// may not be inspected
+bool readExecutable(pid_t pid, uint64_t& device, uint64_t& inode);
+
+// real user id from /proc/<pid>/status
+bool readUid(pid_t pid, uid_t& uid);
+
+// memory counters from /proc/<pid>/statm in kB
+struct Statm {
+    int64_t mResident = 0;
+
+    // data and stack
+    int64_t mData = 0;
+};
+
+bool readStatm(pid_t pid, Statm& statm);
@@ -1,13 +1,25 @@
 #include "recorder.h"
+#include "allocationcounter.h"
 #include "snapshot.h"
 #include "entry.h"
 #include "common.h"
+#include "threadpool.h"
+#include "frame.h"
+#include "index.h"
+#include "sink.h"
+#include "mappedfile.h"
+#include "bytereader.h"
+#include "segment.h"
 #include <dirent.h>
 #include <unistd.h>
 #include <time.h>
-#include <fstream>
 #include <memory>
 #include <set>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <mutex>
+#include <condition_variable>
 
 Recorder::Recorder() {
 }
@@ -19,14 +31,70 @@ void Recorder::setSampleFilePath(const std::string& path) {
     mSampleFilePath = path;
 }
 
-void Recorder::setSampleInterval(std::chrono::seconds interval) {
+void Recorder::setSink(std::unique_ptr<Sink> sink) {
+    mSink = std::move(sink);
+}
+
+void Recorder::setAppend(bool append) {
+    mAppend = append;
+}
+
+void Recorder::setSampleInterval(std::chrono::milliseconds interval) {
     mSampleInterval = interval;
 }
 
+void Recorder::setRotateInterval(std::chrono::seconds interval) {
+    mRotateInterval = interval;
+}
+
+void Recorder::setMaxDiskUsage(uint64_t maxDiskUsage) {
+    mMaxDiskUsage = maxDiskUsage;
+}
+
 void Recorder::setSampleCount(std::optional<int> sampleCount) {
     mSampleCount = sampleCount;
 }
 
+void Recorder::setMaxSampleInterval(std::chrono::milliseconds interval) {
+    mMaxSampleInterval = interval;
+}
+
+void Recorder::setCpuBudget(int percent) {
+    mCpuBudget = std::clamp(percent, 0, 100);
+}
+
+void Recorder::setPrecheckTolerance(int64_t tolerance) {
+    mPrecheckTolerance = tolerance;
+}
+
+void Recorder::setMaxStaleness(std::chrono::milliseconds maxStaleness) {
+    mMaxStaleness = maxStaleness;
+}
+
+void Recorder::setJobCount(int jobCount) {
+    mJobCount = std::max(jobCount, 1);
+}
+
+void Recorder::setCompression(Compression compression) {
+    mCompression = compression;
+}
+
+void Recorder::setKeyframeInterval(int keyframeInterval) {
+    mKeyframeInterval = keyframeInterval;
+}
+
+void Recorder::setMode(Mode mode) {
+    mMode = mode;
+}
+
+void Recorder::setProcessFilter(ProcessFilter filter) {
+    mProcessFilter = std::move(filter);
+}
+
+void Recorder::setRollupUpgradeThreshold(int64_t threshold) {
+    mRollupUpgradeThreshold = threshold;
+}
+
 bool Recorder::isPidDir(const struct dirent* entry) {
     const char* p;
 
@@ -39,26 +107,211 @@ bool Recorder::isPidDir(const struct dirent* entry) {
     return true;
 }
 
-void Recorder::recordSnapshots(std::ofstream& stream, bool firstTake) {
-    printf("taking snapshots\n");
+void Recorder::checkRollupUpgrade(const Snapshot& snapshot) {
+    auto heapUsage = snapshot.heapUsage();
+    auto it = mRollupBaselines.find(snapshot.processId());
+    if (it == mRollupBaselines.end()) {
+        mRollupBaselines[snapshot.processId()] = heapUsage;
+        return;
+    }
 
-    auto dir = opendir("/proc");
-    if (!dir) {
-        printf("failed to open /proc (errno=%d)\n", errno);
-        exit(1);
+    if (mRollupUpgradeThreshold > 0
+        && heapUsage - it->second > mRollupUpgradeThreshold) {
+        printf("process %s [%d] grew by %dkB, recording full smaps\n",
+               snapshot.name().c_str(),
+               snapshot.processId(),
+               static_cast<int>(heapUsage - it->second));
+        mUpgradedPids.insert(snapshot.processId());
     }
+}
 
-    auto timestamp = time(nullptr);
+int Recorder::maxPeriod() const {
+    if (mSampleInterval.count() <= 0) {
+        return 1;
+    }
+    return std::max(1, static_cast<int>(mMaxSampleInterval / mSampleInterval));
+}
 
-    int totalCount = 0;
-    int changedCount = 0;
-    int newCount = 0;
+std::vector<pid_t> Recorder::selectPids(const std::vector<pid_t>& pids) {
+    auto maxPeriod = this->maxPeriod();
 
-    std::set<pid_t> prevPids;
-    for (const auto& it : mPrevSnapshots) {
-        prevPids.insert(it.second->processId());
+    size_t limit = pids.size();
+    if (mCpuBudget > 0 && mSnapshotCost > 0) {
+        auto budget = mSampleInterval.count() * mCpuBudget / 100.0;
+        limit = std::max<size_t>(1, static_cast<size_t>(budget / mSnapshotCost));
+    }
+
+    if (maxPeriod == 1 && limit >= pids.size()) {
+        return pids;
+    }
+
+    // new processes first, then the fastest growing ones, processes that
+    // had to wait move up so that none of them starves
+    std::vector<std::pair<double, pid_t>> due;
+    for (auto pid : pids) {
+        // a reused pid must not inherit the backed off period of the
+        // process that ended
+        auto it = mSchedules.find(pid);
+        uint64_t startTime = 0;
+        if (it != mSchedules.end()
+            && readStartTime(pid, startTime)
+            && startTime != it->second.mStartTime) {
+            mSchedules.erase(it);
+            it = mSchedules.end();
+        }
+
+        if (it == mSchedules.end()) {
+            due.emplace_back(std::numeric_limits<double>::max(), pid);
+            continue;
+        }
+
+        auto& schedule = it->second;
+        schedule.mAge++;
+        if (schedule.mAge >= schedule.mPeriod) {
+            auto overdue = schedule.mAge - schedule.mPeriod;
+            due.emplace_back((std::abs(schedule.mSlope) + 1) * (overdue + 1), pid);
+        }
+    }
+
+    if (due.size() > limit) {
+        std::partial_sort(due.begin(), due.begin() + limit, due.end(), [](const auto& a, const auto& b) {
+            return a.first > b.first;
+        });
+        due.resize(limit);
+    }
+
+    std::vector<pid_t> selected;
+    for (const auto& it : due) {
+        selected.push_back(it.second);
+    }
+    std::sort(selected.begin(), selected.end());
+    return selected;
+}
+
+std::vector<pid_t> Recorder::precheckPids(const std::vector<pid_t>& pids, bool keyframe) {
+    if (mPrecheckTolerance < 0) {
+        return pids;
     }
 
+    auto now = currentTimeMillis();
+
+    std::vector<pid_t> changed;
+    for (auto pid : pids) {
+        Statm statm;
+        uint64_t startTime = 0;
+        if (!readStatm(pid, statm) || !readStartTime(pid, startTime)) {
+            // let the full snapshot report the problem
+            changed.push_back(pid);
+            continue;
+        }
+
+        // only processes with a delta base in the archive can be skipped
+        auto it = mPrechecks.find(pid);
+        if (keyframe
+            || it == mPrechecks.end()
+            || it->second.mStartTime != startTime
+            || mPrevSnapshots.find(pid) == mPrevSnapshots.end()) {
+            mPrechecks[pid] = {statm, startTime, now};
+            changed.push_back(pid);
+            continue;
+        }
+
+        // compared to the last full snapshot, so slow drift adds up
+        auto& precheck = it->second;
+        if (std::abs(statm.mResident - precheck.mStatm.mResident) > mPrecheckTolerance
+            || std::abs(statm.mData - precheck.mStatm.mData) > mPrecheckTolerance
+            || now - precheck.mTimestamp >= mMaxStaleness.count()) {
+            precheck = {statm, startTime, now};
+            changed.push_back(pid);
+        }
+    }
+
+    return changed;
+}
+
+void Recorder::updateSchedule(const Snapshot& snapshot, bool changed) {
+    auto& schedule = mSchedules[snapshot.processId()];
+
+    // upgraded processes keep the quantity of their rollup entry, so the
+    // upgrade does not count as a change, see Process::heapUsage()
+    auto heapUsage = mMode == Mode::rollup ? snapshot.usage().mAnonymous : snapshot.heapUsage();
+    bool heapChanged = schedule.mTimestamp == 0 || heapUsage != schedule.mHeapUsage;
+
+    if (schedule.mTimestamp != 0 && snapshot.timestamp() > schedule.mTimestamp) {
+        auto slope = (heapUsage - schedule.mHeapUsage) / ((snapshot.timestamp() - schedule.mTimestamp) / 1000.0);
+        schedule.mSlope = (schedule.mSlope + slope) / 2;
+    }
+
+    // a growing heap is sampled every sweep, a process that does not
+    // change at all backs off exponentially
+    if (heapChanged) {
+        schedule.mPeriod = 1;
+    } else if (!changed) {
+        schedule.mPeriod = std::min(schedule.mPeriod * 2, maxPeriod());
+    }
+
+    schedule.mAge = 0;
+    schedule.mStartTime = snapshot.identity().mStartTime;
+    schedule.mHeapUsage = heapUsage;
+    schedule.mTimestamp = snapshot.timestamp();
+}
+
+std::unique_ptr<Snapshot> Recorder::spareSnapshot(pid_t pid) {
+    auto& spare = mSpareSnapshots[pid];
+    if (!spare) {
+        return std::make_unique<Snapshot>();
+    }
+    return std::move(spare);
+}
+
+void Recorder::recycleSnapshot(std::unique_ptr<Snapshot> snapshot) {
+    auto pid = snapshot->processId();
+    snapshot->recycle();
+
+    // the map entry stays, so this does not allocate in steady state
+    auto& spare = mSpareSnapshots[pid];
+    if (!spare) {
+        spare = std::move(snapshot);
+    }
+}
+
+void Recorder::forgetProcess(ByteWriter& writer, pid_t pid) {
+    auto it = mPrevSnapshots.find(pid);
+    if (it != mPrevSnapshots.end()) {
+        it->second->writeToFileKilled(writer);
+        mPrevSnapshots.erase(it);
+    }
+    mSpareSnapshots.erase(pid);
+    mRollupBaselines.erase(pid);
+    mUpgradedPids.erase(pid);
+    mSchedules.erase(pid);
+    mPrechecks.erase(pid);
+}
+
+void Recorder::dropDeltaBase(ByteWriter& writer, pid_t pid) {
+    auto it = mPrevSnapshots.find(pid);
+    if (it == mPrevSnapshots.end()) {
+        return;
+    }
+
+    it->second->writeToFileKilled(writer);
+    recycleSnapshot(std::move(it->second));
+    mPrevSnapshots.erase(it);
+}
+
+bool Recorder::takeSnapshot(Snapshot& snapshot, Snapshot::Source source) {
+    return snapshot.take(source);
+}
+
+// returns the ids of all processes except ourself in ascending order
+std::vector<pid_t> Recorder::listPids() {
+    auto dir = opendir("/proc");
+    if (!dir) {
+        printf("failed to open /proc (errno=%d)\n", errno);
+        exit(1);
+    }
+
+    std::vector<pid_t> pids;
     while (auto entry = readdir(dir)) {
         if (!isPidDir(entry)) {
             continue;
@@ -71,26 +324,158 @@ void Recorder::recordSnapshots(std::ofstream& stream, bool firstTake) {
             continue;
         }
 
-        prevPids.erase(pid);
+        pids.push_back(pid);
+    }
 
-        auto snapshot = std::make_unique<Snapshot>(pid, timestamp);
-        if(snapshot->take()) {
-            Snapshot* prevSnapshot = nullptr;
+    closedir(dir);
+
+    std::sort(pids.begin(), pids.end());
+    return pids;
+}
+
+void Recorder::recordSnapshots(ByteWriter& writer, bool firstTake, bool keyframe) {
+    printf("taking snapshots\n");
+
+    auto takeStart = std::chrono::steady_clock::now();
+
+    // keyframes need every process, processes that stop passing the filter
+    // are handled like ended ones
+    auto allPids = mProcessFilter.apply(listPids());
+
+    // both are sorted by pid
+    std::vector<pid_t> prevPids;
+    auto allIt = allPids.begin();
+    for (const auto& it : mPrevSnapshots) {
+        while (allIt != allPids.end() && *allIt < it.first) {
+            ++allIt;
+        }
+        if (allIt == allPids.end() || *allIt != it.first) {
+            prevPids.push_back(it.first);
+        }
+    }
+
+    auto pids = precheckPids(keyframe ? allPids : selectPids(allPids), keyframe);
+
+    // decided up front, the worker threads must not look at mUpgradedPids
+    std::vector<Snapshot::Source> sources(pids.size(), Snapshot::Source::smaps);
+    if (mMode == Mode::rollup) {
+        for (size_t i = 0; i < pids.size(); i++) {
+            if (mUpgradedPids.find(pids[i]) == mUpgradedPids.end()) {
+                sources[i] = Snapshot::Source::smapsRollup;
+            }
+        }
+    }
+
+    int totalCount = 0;
+    int changedCount = 0;
+    int newCount = 0;
+
+    // Snapshots are taken by the thread pool in any order, but written in
+    // pid order by this thread as soon as the next one in line is done.
+    // They are handed out up front, the worker threads must not touch
+    // mSpareSnapshots.
+    std::vector<std::unique_ptr<Snapshot>> snapshots(pids.size());
+    for (size_t i = 0; i < pids.size(); i++) {
+        snapshots[i] = spareSnapshot(pids[i]);
+    }
+
+    // 0 while pending, 1 if taken, 2 if taking failed
+    std::vector<char> taken(pids.size(), 0);
+    std::mutex mutex;
+    std::condition_variable snapshotTaken;
+
+    auto takeAt = [&](size_t index) {
+        // stamped when it is actually taken, a sweep can take a while
+        auto& snapshot = *snapshots[index];
+        snapshot.reset(pids[index], currentTimeMillis());
+        bool ok = takeSnapshot(snapshot, sources[index]);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        taken[index] = ok ? 1 : 2;
+        snapshotTaken.notify_one();
+    };
+
+    if (mJobCount > 1) {
+        if (!mThreadPool) {
+            mThreadPool = std::make_unique<ThreadPool>(mJobCount);
+        }
+
+        for (size_t i = 0; i < pids.size(); i++) {
+            mThreadPool->submit([&takeAt, i] { takeAt(i); });
+        }
+    }
+
+    for (size_t i = 0; i < pids.size(); i++) {
+        std::unique_ptr<Snapshot> snapshot;
+        if (mJobCount > 1) {
+            std::unique_lock<std::mutex> lock(mutex);
+            snapshotTaken.wait(lock, [&] { return taken[i] != 0; });
+            snapshot = std::move(snapshots[i]);
+        } else {
+            takeAt(i);
+            snapshot = std::move(snapshots[i]);
+        }
+
+        if (taken[i] != 1) {
+            // Later frames must not reference a delta base from before a
+            // keyframe, or reading from the keyframe on fails. The
+            // process is written standalone when it is taken again.
+            if (keyframe) {
+                dropDeltaBase(writer, pids[i]);
+            }
+            recycleSnapshot(std::move(snapshot));
+        } else {
+            // the pid was reused since the last sweep, the old process
+            // ended, so none of its state may be applied to the new one
             auto it = mPrevSnapshots.find(snapshot->processId());
+            if (it != mPrevSnapshots.end() && it->second->identity() != snapshot->identity()) {
+                forgetProcess(writer, snapshot->processId());
+                it = mPrevSnapshots.end();
+            }
+
+            if (sources[i] == Snapshot::Source::smapsRollup) {
+                checkRollupUpgrade(*snapshot);
+            }
+
+            Snapshot* prevSnapshot = nullptr;
+            bool changed = true;
             if (it != mPrevSnapshots.end()) {
                 prevSnapshot = it->second.get();
-                if (prevSnapshot->isEqualTo(*snapshot)) {
-                    totalCount++;
-                    continue;
-                }
+                changed = !prevSnapshot->isEqualTo(*snapshot);
             } else {
                 newCount++;
             }
-            snapshot->writeToFile(stream, prevSnapshot);
-            if (!firstTake) {
-                printf("process %s [%d] changed\n", snapshot->name().c_str(), snapshot->processId());
+            updateSchedule(*snapshot, changed);
+
+            // unchanged processes are only written to keyframes
+            if (changed || keyframe) {
+                IndexRecord record;
+                record.mProcessId = snapshot->processId();
+                record.mStartTime = snapshot->identity().mStartTime;
+                record.mTimestamp = snapshot->timestamp();
+                record.mSnapshotOffset = static_cast<uint32_t>(writer.offset());
+                record.mStandalone = keyframe || !prevSnapshot;
+                mSweepIndex.push_back(record);
+
+                snapshot->writeToFile(writer, keyframe ? nullptr : prevSnapshot);
+
+                // whatever was written is the delta base for the reader now
+                if (changed && !firstTake) {
+                    printf("process %s [%d] changed\n", snapshot->name().c_str(), snapshot->processId());
+                }
+                auto& prev = mPrevSnapshots[snapshot->processId()];
+                if (prev) {
+                    recycleSnapshot(std::move(prev));
+                }
+                prev = std::move(snapshot);
+            } else {
+                recycleSnapshot(std::move(snapshot));
+            }
+
+            if (!changed) {
+                totalCount++;
+                continue;
             }
-            mPrevSnapshots[snapshot->processId()] = std::move(snapshot);
         }
 
 
@@ -98,45 +483,349 @@ void Recorder::recordSnapshots(std::ofstream& stream, bool firstTake) {
         totalCount++;
     }
 
+    if (mThreadPool) {
+        mThreadPool->wait();
+    }
+
+    if (!pids.empty()) {
+        auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - takeStart).count();
+        auto cost = elapsed / pids.size();
+        mSnapshotCost = mSnapshotCost > 0 ? (mSnapshotCost + cost) / 2 : cost;
+    }
+
     if (firstTake) {
         printf("took snapshots of %d processes\n", totalCount);
     } else {
-        printf("took snapshots of %d processes, %d changed, %d new, %d removed\n", totalCount, changedCount, newCount, static_cast<int>(prevPids.size()));
+        printf("took snapshots of %d processes, %d changed, %d new, %d removed, %d not due\n",
+               totalCount, changedCount, newCount, static_cast<int>(prevPids.size()),
+               static_cast<int>(allPids.size() - pids.size()));
     }
 
     for (auto pid : prevPids) {
-        auto it = mPrevSnapshots.find(pid);
-        it->second->writeToFileKilled(stream);
-        mPrevSnapshots.erase(it);
+        forgetProcess(writer, pid);
     }
+}
 
-    closedir(dir);
+static bool writeArchiveHeader(Sink& sink) {
+    ByteWriter header;
+    header.writeUInt32(ARCHIVE_VERSION);
+    return sink.write(header.data());
 }
 
-void Recorder::record() {
-    unlink(mSampleFilePath.c_str());
+bool Recorder::resume(uint64_t& archiveSize, int& sweepsSinceKeyframe) {
+    archiveSize = 0;
+    sweepsSinceKeyframe = 0;
+
+    MappedFile file;
+    if (!file.open(mArchivePath) || file.size() < sizeof(uint32_t)) {
+        // nothing to continue
+        return true;
+    }
+
+    ByteReader reader(file.view());
+    uint32_t version = 0;
+    reader.readUInt32(version);
+    if (version != ARCHIVE_VERSION) {
+        printf("cannot append to archive version %u, expected %u\n", version, ARCHIVE_VERSION);
+        return false;
+    }
+
+    // only the frames from the last keyframe on are needed to restore the
+    // delta bases, everything before is skipped by its header
+    size_t startOffset = reader.offset();
+    while (true) {
+        auto offset = reader.offset();
+        bool keyframe = false;
+        if (skipFrame(reader, keyframe) != ReadFrameResult::ok) {
+            break;
+        }
+        if (keyframe) {
+            startOffset = offset;
+        }
+    }
+
+    reader.seek(startOffset);
+    archiveSize = startOffset;
+
+    std::map<ProcessIdentity, Snapshot*> prevSnapshots;
+    const std::map<ProcessIdentity, Snapshot*> noPrevSnapshots;
+    std::string buffer;
+    while (true) {
+        // only a frame cut off by a crash is dropped, anything else means
+        // the archive is damaged and truncating it would lose recorded data
+        auto frameOffset = reader.offset();
+        auto frameStart = reader;
+        bool keyframe = false;
+        std::string_view frame;
+        auto res = readFrame(reader, buffer, frame, keyframe);
+        if (res == ReadFrameResult::end) {
+            break;
+        }
+        if (res == ReadFrameResult::truncated && isTornFrame(frameStart)) {
+            printf("dropping incomplete frame at the end of %s\n", mArchivePath.c_str());
+            break;
+        }
+        if (res != ReadFrameResult::ok) {
+            printf("frame at offset %zu of %s is damaged, not appending to it\n", frameOffset, mArchivePath.c_str());
+            return false;
+        }
+
+        // a frame is only taken over if all of its snapshots decode
+        // killed markers and snapshots are replayed in order, a pid can
+        // end and be reused within one frame
+        std::vector<std::pair<std::unique_ptr<Snapshot>, bool>> snapshots;
+        std::map<ProcessIdentity, Snapshot*> framePrevSnapshots = prevSnapshots;
+        ByteReader frameReader(frame);
+        bool ok = true;
+        while (ok && !frameReader.atEnd()) {
+            auto snapshot = std::make_unique<Snapshot>();
+            auto res = snapshot->readFromFile(frameReader, version, keyframe ? noPrevSnapshots : framePrevSnapshots);
+            if (res == Snapshot::ReadFileResult::failed) {
+                ok = false;
+                continue;
+            }
+
+            bool killed = res == Snapshot::ReadFileResult::killed;
+            if (killed) {
+                framePrevSnapshots.erase(snapshot->identity());
+            } else {
+                framePrevSnapshots[snapshot->identity()] = snapshot.get();
+            }
+            snapshots.emplace_back(std::move(snapshot), killed);
+        }
+
+        if (!ok) {
+            printf("cannot decode frame at offset %zu of %s, not appending to it\n", frameOffset, mArchivePath.c_str());
+            return false;
+        }
+
+        for (auto& it : snapshots) {
+            auto& snapshot = it.first;
+            auto pid = snapshot->processId();
+            if (it.second) {
+                auto prevIt = mPrevSnapshots.find(pid);
+                if (prevIt != mPrevSnapshots.end() && prevIt->second->identity() == snapshot->identity()) {
+                    mPrevSnapshots.erase(prevIt);
+                }
+                continue;
+            }
+            mPrevSnapshots[pid] = std::move(snapshot);
+        }
+        prevSnapshots = framePrevSnapshots;
+
+        archiveSize = reader.offset();
+        sweepsSinceKeyframe++;
+    }
+
+    // processes that are gone by now get their killed marker with the
+    // next sweep
+    if (mMode == Mode::rollup) {
+        for (const auto& it : mPrevSnapshots) {
+            if (it.second->entries().size() > 1) {
+                mUpgradedPids.insert(it.first);
+            }
+        }
+    }
+
+    printf("continuing %s with %d processes\n", mArchivePath.c_str(), static_cast<int>(mPrevSnapshots.size()));
+    return true;
+}
+
+void Recorder::openSinks(bool append, std::unique_ptr<Sink>& indexSink, int& sweepsSinceKeyframe) {
+    sweepsSinceKeyframe = 0;
+    if (mSink) {
+        // no index for custom sinks
+        if (!writeArchiveHeader(*mSink)) {
+            printf("failed to write archive header\n");
+            exit(1);
+        }
+        return;
+    }
+
+    uint64_t archiveSize = 0;
+    if (append && !resume(archiveSize, sweepsSinceKeyframe)) {
+        exit(1);
+    }
+
+    auto sink = std::make_unique<FileSink>();
+    bool opened = archiveSize > 0 ? sink->reopen(mArchivePath, archiveSize) : sink->open(mArchivePath);
+    if (!opened) {
+        printf("failed to open snapshots file %s\n", mArchivePath.c_str());
+        exit(1);
+    }
 
-    std::ofstream stream(mSampleFilePath.c_str(), std::ofstream::binary | std::ofstream::ate | std::ofstream::out);
-    if (!stream.is_open()) {
-        printf("failed to open snapshots file %s\n", mSampleFilePath.c_str());
+    if (archiveSize == 0 && !writeArchiveHeader(*sink)) {
+        printf("failed to write to snapshots file %s\n", mArchivePath.c_str());
         exit(1);
     }
 
-    constexpr uint32_t version = 1;
-    writeUInt32(stream, version);
+    // the index holds file offsets, which are useless for a pipe
+    if (sink->isSeekable()) {
+        auto indexPath = indexFilePath(mArchivePath);
+        auto index = std::make_unique<FileSink>();
+        uint64_t indexSize = 0;
+        if (archiveSize > 0) {
+            // without a matching index the archive is read sequentially
+            if (!validIndexSize(indexPath, archiveSize, indexSize) || !index->reopen(indexPath, indexSize)) {
+                printf("no usable index file %s, not writing one\n", indexPath.c_str());
+                unlink(indexPath.c_str());
+                index.reset();
+            }
+        } else if (!index->open(indexPath) || !writeIndexHeader(*index)) {
+            printf("failed to open index file %s\n", indexPath.c_str());
+            exit(1);
+        }
+        indexSink = std::move(index);
+    }
+
+    mSink = std::move(sink);
+}
+
+uint64_t Recorder::removeOldSegments() {
+    auto segments = listSegments(mSampleFilePath);
+
+    uint64_t diskUsage = 0;
+    for (const auto& segment : segments) {
+        diskUsage += archiveDiskUsage(segment);
+    }
+
+    for (const auto& segment : segments) {
+        if (diskUsage <= mMaxDiskUsage || segment == mArchivePath) {
+            break;
+        }
+
+        printf("removing old segment %s\n", segment.c_str());
+        diskUsage -= archiveDiskUsage(segment);
+        unlink(segment.c_str());
+        unlink(indexFilePath(segment).c_str());
+    }
+
+    return diskUsage - std::min(diskUsage, archiveDiskUsage(mArchivePath));
+}
+
+void Recorder::waitForNextSample(std::chrono::steady_clock::time_point start,
+                                 std::chrono::steady_clock::time_point& deadline) {
+    auto now = std::chrono::steady_clock::now();
+    deadline += mSampleInterval;
+    if (now > deadline && mSampleInterval.count() > 0) {
+        auto missed = (now - deadline) / mSampleInterval + 1;
+        deadline += missed * mSampleInterval;
+        printf("sweep took %d ms, longer than the sampling interval of %d ms, skipping %d samples\n",
+               static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(now - start).count()),
+               static_cast<int>(mSampleInterval.count()),
+               static_cast<int>(missed));
+    }
+
+    // an absolute deadline does not drift by the time the sweep took, and
+    // steady_clock is CLOCK_MONOTONIC on Linux
+    auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch()).count();
+    struct timespec ts;
+    ts.tv_sec = nanoseconds / 1000000000;
+    ts.tv_nsec = nanoseconds % 1000000000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {
+    }
+}
+
+void Recorder::record() {
+    bool rotate = !mSink && mRotateInterval.count() > 0;
+    bool append = mAppend;
+    auto segmentStart = time(nullptr);
+
+    mArchivePath = mSampleFilePath;
+    if (rotate) {
+        auto segments = listSegments(mSampleFilePath);
+        if (append && !segments.empty() && segmentStartTime(segments.back(), segmentStart)) {
+            mArchivePath = segments.back();
+        } else {
+            append = false;
+            mArchivePath = segmentFilePath(mSampleFilePath, segmentStart);
+        }
+    }
+
+    std::unique_ptr<Sink> indexSink;
+    int sweepsSinceKeyframe = 0;
+    openSinks(append, indexSink, sweepsSinceKeyframe);
+
+    // disk usage of all segments but the current one
+    uint64_t olderSegmentsUsage = 0;
+    bool limitDiskUsage = rotate && mMaxDiskUsage > 0;
+    if (limitDiskUsage) {
+        olderSegmentsUsage = removeOldSegments();
+    }
+
+    auto deadline = std::chrono::steady_clock::now();
 
     int count = 0;
     while (true) {
-        recordSnapshots(stream, count == 0);
-        stream.flush();
+        auto sweepStart = std::chrono::steady_clock::now();
+        auto allocationStart = allocationCount();
+
+        // new segments start with a keyframe, so they can be read on their own
+        bool keyframe = sweepsSinceKeyframe == 0
+            || (mKeyframeInterval > 0 && sweepsSinceKeyframe % mKeyframeInterval == 0);
+
+        // every sweep is encoded in memory and written as one frame
+        mSweep.clear();
+        mSweepIndex.clear();
+        recordSnapshots(mSweep, count == 0 && mPrevSnapshots.empty(), keyframe);
 
-        sleep(mSampleInterval.count());
+        if (mSweep.offset() > 0) {
+            auto frameOffset = mSink->offset();
+            if (!writeFrame(*mSink, mCompression, keyframe, mSweep.data())) {
+                printf("failed to write to snapshots file %s\n", mArchivePath.c_str());
+                exit(1);
+            }
+
+            // the index is written after the frame, so it never points
+            // to data that is not in the archive yet
+            if (indexSink) {
+                for (auto& record : mSweepIndex) {
+                    record.mFrameOffset = frameOffset;
+                }
+                writeIndexRecords(*indexSink, mSweepIndex);
+            }
+        }
+        sweepsSinceKeyframe++;
+        printAllocationCount("sweep", allocationStart);
+
+        // the current segment counts against the limit while it grows,
+        // the oldest segments go first, then the current one is rotated
+        // early so that it can be removed as well
+        bool overLimit = false;
+        if (limitDiskUsage) {
+            overLimit = olderSegmentsUsage + archiveDiskUsage(mArchivePath) > mMaxDiskUsage;
+            if (overLimit && olderSegmentsUsage > 0) {
+                olderSegmentsUsage = removeOldSegments();
+                overLimit = olderSegmentsUsage + archiveDiskUsage(mArchivePath) > mMaxDiskUsage;
+            }
+        }
 
         count++;
         if (mSampleCount
             && *mSampleCount == count) {
             break;
         }
+
+        auto now = time(nullptr);
+        if (rotate && (now - segmentStart >= mRotateInterval.count() || overLimit)) {
+            // names have a resolution of a second, an early rotation may
+            // have to wait for the next sweep
+            auto segmentPath = segmentFilePath(mSampleFilePath, now);
+            if (segmentPath != mArchivePath) {
+                segmentStart = now;
+                mArchivePath = segmentPath;
+                printf("starting new segment %s\n", mArchivePath.c_str());
+
+                mSink.reset();
+                indexSink.reset();
+                openSinks(false, indexSink, sweepsSinceKeyframe);
+
+                if (limitDiskUsage) {
+                    olderSegmentsUsage = removeOldSegments();
+                }
+            }
+        }
+
+        waitForNextSample(sweepStart, deadline);
     }
 }
-
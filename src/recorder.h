@@ -1,5 +1,11 @@
 #pragma once
 #include "common.h"
+#include "frame.h"
+#include "index.h"
+#include "bytewriter.h"
+#include "processfilter.h"
+#include "procfs.h"
+#include "snapshot.h"
 
 #include <string>
 #include <vector>
@@ -9,33 +15,229 @@
 #include <chrono>
 #include <map>
 #include <memory>
+#include <set>
 
-class Snapshot;
+class ThreadPool;
+class Sink;
 
 class Recorder {
 public:
+    enum class Mode {
+        // record every mapping of every process
+        full,
+        // record per process totals only
+        rollup,
+    };
+
     Recorder();
 
-    ~Recorder();
+    virtual ~Recorder();
 
     void record();
 
     void setSampleFilePath(const std::string& path);
 
-    void setSampleInterval(std::chrono::seconds interval);
+    // writes the archive to sink instead of the sample file, no index is
+    // written in that case
+    void setSink(std::unique_ptr<Sink> sink);
+
+    // continue an existing archive instead of replacing it
+    void setAppend(bool append);
+
+    void setSampleInterval(std::chrono::milliseconds interval);
+
+    // starts a new segment of the recording after this time, 0 disables
+    // rotation, see segment.h
+    void setRotateInterval(std::chrono::seconds interval);
+
+    // removes the oldest segments when all of them take more than this
+    // many bytes, checked after every sweep, 0 means no limit
+    void setMaxDiskUsage(uint64_t maxDiskUsage);
 
     void setSampleCount(std::optional<int> sampleCount);
 
+    // processes that do not change are sampled less often, down to once
+    // per this interval, the sampling interval disables this
+    void setMaxSampleInterval(std::chrono::milliseconds interval);
+
+    // percentage of the sampling interval a sweep may spend taking
+    // snapshots, the processes that grow fastest are taken first, 0 means
+    // no limit
+    void setCpuBudget(int percent);
+
+    // Before smaps is read, the resident and data size from statm are
+    // compared to the ones of the last full snapshot. The process is only
+    // taken again if one of them moved by more than tolerance kB, or if
+    // its last full snapshot is older than the max staleness. A negative
+    // tolerance disables the check.
+    void setPrecheckTolerance(int64_t tolerance);
+
+    void setMaxStaleness(std::chrono::milliseconds maxStaleness);
+
+    // number of processes whose smaps are parsed concurrently
+    void setJobCount(int jobCount);
+
+    void setCompression(Compression compression);
+
+    // number of sweeps between two keyframes, 0 disables keyframes
+    void setKeyframeInterval(int keyframeInterval);
+
+    void setMode(Mode mode);
+
+    // only processes passing the filter are recorded
+    void setProcessFilter(ProcessFilter filter);
+
+    // in rollup mode, processes whose heap grew by more than this many kB
+    // since their first snapshot are recorded with full detail from then on
+    void setRollupUpgradeThreshold(int64_t threshold);
+
+protected:
+    // reads the smaps of one process, called from the worker threads
+    virtual bool takeSnapshot(Snapshot& snapshot, Snapshot::Source source);
+
 private:
     static bool isPidDir(const struct dirent* entry);
 
-    void recordSnapshots(std::ofstream& stream, bool firstTake);
+    static std::vector<pid_t> listPids();
+
+    void checkRollupUpgrade(const Snapshot& snapshot);
+
+    // longest sampling period in sweeps
+    int maxPeriod() const;
+
+    // the processes to sample in this sweep
+    std::vector<pid_t> selectPids(const std::vector<pid_t>& pids);
+
+    // drops the processes whose statm did not move enough, keyframes only
+    // update the statm of all processes
+    std::vector<pid_t> precheckPids(const std::vector<pid_t>& pids, bool keyframe);
+
+    // adapts the sampling period of a process to how it changed
+    void updateSchedule(const Snapshot& snapshot, bool changed);
+
+    // writes the killed marker of a process and drops all state kept for it
+    void forgetProcess(ByteWriter& writer, pid_t pid);
+
+    // writes the killed marker of a process that is still alive, so its
+    // next snapshot is written without delta base
+    void dropDeltaBase(ByteWriter& writer, pid_t pid);
+
+    // the recycled snapshot of the process or a new one
+    std::unique_ptr<Snapshot> spareSnapshot(pid_t pid);
+
+    // keeps the snapshot for the next sweep of its process, which has
+    // about the same number of mappings, so taking snapshots reuses their
+    // memory instead of allocating
+    void recycleSnapshot(std::unique_ptr<Snapshot> snapshot);
+
+    // validates the existing archive, restores the delta bases from its
+    // last keyframe on and returns the size of the intact part, false if
+    // the archive is damaged anywhere but in a torn last frame
+    bool resume(uint64_t& archiveSize, int& sweepsSinceKeyframe);
+
+    // opens the archive and index sinks, writes the headers of new files
+    void openSinks(bool append, std::unique_ptr<Sink>& indexSink, int& sweepsSinceKeyframe);
+
+    // removes the oldest segments until the disk usage limit is met,
+    // returns the disk usage of the remaining ones except the current one
+    uint64_t removeOldSegments();
+
+    // sleeps until the next multiple of the sampling interval after start,
+    // sweeps that do not fit into the interval skip the missed samples
+    void waitForNextSample(std::chrono::steady_clock::time_point start,
+                           std::chrono::steady_clock::time_point& deadline);
+
+    void recordSnapshots(ByteWriter& writer, bool firstTake, bool keyframe);
 
     std::string mSampleFilePath = DEFAULT_SAMPLE_FILE_NAME;
 
-    std::chrono::seconds mSampleInterval = std::chrono::minutes(1);
+    // the file currently written to, a segment when rotating
+    std::string mArchivePath;
+
+    std::chrono::seconds mRotateInterval = std::chrono::seconds(0);
+
+    uint64_t mMaxDiskUsage = 0;
+
+    std::unique_ptr<Sink> mSink;
+
+    bool mAppend = false;
+
+    // the encoded snapshots of the current sweep, reused across sweeps
+    ByteWriter mSweep;
+
+    std::chrono::milliseconds mSampleInterval = DEFAULT_SAMPLING_INTERVAL;
 
     std::optional<int> mSampleCount;
 
+    std::chrono::milliseconds mMaxSampleInterval = std::chrono::milliseconds(0);
+
+    int mCpuBudget = 0;
+
+    // adaptive sampling state of a process
+    struct Schedule {
+        // sampled every mPeriod sweeps
+        int mPeriod = 1;
+
+        // sweeps since the last sample
+        int mAge = 0;
+
+        // of the process the schedule was made for, pids are reused
+        uint64_t mStartTime = 0;
+
+        int64_t mHeapUsage = 0;
+
+        int64_t mTimestamp = 0;
+
+        // smoothed heap growth in kB/s
+        double mSlope = 0;
+    };
+
+    std::map<pid_t, Schedule> mSchedules;
+
+    int64_t mPrecheckTolerance = -1;
+
+    std::chrono::milliseconds mMaxStaleness = std::chrono::minutes(10);
+
+    struct Precheck {
+        // statm at the last full snapshot
+        Statm mStatm;
+
+        // a reused pid is never skipped
+        uint64_t mStartTime = 0;
+
+        int64_t mTimestamp = 0;
+    };
+
+    std::map<pid_t, Precheck> mPrechecks;
+
+    // smoothed wall time per snapshot in ms, for the CPU budget
+    double mSnapshotCost = 0;
+
+    int mJobCount = 1;
+
+    Compression mCompression = defaultCompression();
+
+    int mKeyframeInterval = DEFAULT_KEYFRAME_INTERVAL;
+
+    // index records of the snapshots in the current sweep
+    std::vector<IndexRecord> mSweepIndex;
+
+    Mode mMode = Mode::full;
+
+    ProcessFilter mProcessFilter;
+
+    int64_t mRollupUpgradeThreshold = DEFAULT_ROLLUP_UPGRADE_THRESHOLD;
+
+    // heap usage of each process when it was first seen in rollup mode
+    std::map<pid_t, int64_t> mRollupBaselines;
+
+    // processes recorded with full detail in rollup mode
+    std::set<pid_t> mUpgradedPids;
+
+    std::unique_ptr<ThreadPool> mThreadPool;
+
     std::map<pid_t, std::unique_ptr<Snapshot>> mPrevSnapshots;
+
+    // at most one per process, see recycleSnapshot()
+    std::map<pid_t, std::unique_ptr<Snapshot>> mSpareSnapshots;
 };
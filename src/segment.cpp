@@ -0,0 +1,156 @@
+#include "segment.h"
+#include "common.h"
+#include "index.h"
+#include <algorithm>
+#include <dirent.h>
+#include <glob.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
+static constexpr const char* SEGMENT_TIME_FORMAT = "%Y%m%d-%H%M%S";
+
+static bool endsWith(const std::string& str, const std::string& suffix) {
+    return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+static bool isIndexFile(const std::string& path) {
+    return endsWith(path, indexFilePath(""));
+}
+
+static bool isRegularFile(const std::string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+}
+
+static bool isDirectory(const std::string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+// checks the version at the start of the file, so that other files next to
+// the archives, e.g. logs, are not mistaken for them
+static bool hasArchiveHeader(const std::string& path) {
+    auto file = fopen(path.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+
+    uint32_t version = 0;
+    bool ok = fread(&version, sizeof(version), 1, file) == 1;
+    fclose(file);
+    return ok && version >= 1 && version <= ARCHIVE_VERSION;
+}
+
+// drops the paths that are no archives and reports them
+static void removeNonArchives(std::vector<std::string>& paths) {
+    paths.erase(std::remove_if(paths.begin(), paths.end(), [](const std::string& path) {
+                    if (hasArchiveHeader(path)) {
+                        return false;
+                    }
+                    printf("skipping %s, not an archive\n", path.c_str());
+                    return true;
+                }),
+                paths.end());
+}
+
+// matching archives sorted by name, index files are skipped
+static std::vector<std::string> globArchives(const std::string& pattern) {
+    std::vector<std::string> paths;
+
+    glob_t result;
+    if (glob(pattern.c_str(), 0, nullptr, &result) == 0) {
+        for (size_t i = 0; i < result.gl_pathc; i++) {
+            std::string path = result.gl_pathv[i];
+            if (!isIndexFile(path) && isRegularFile(path)) {
+                paths.push_back(path);
+            }
+        }
+    }
+    globfree(&result);
+
+    return paths;
+}
+
+std::string segmentFilePath(const std::string& sampleFilePath, time_t start) {
+    struct tm tm;
+    gmtime_r(&start, &tm);
+
+    char buf[32];
+    strftime(buf, sizeof(buf), SEGMENT_TIME_FORMAT, &tm);
+    return sampleFilePath + "." + buf;
+}
+
+bool segmentStartTime(const std::string& segmentPath, time_t& start) {
+    auto pos = segmentPath.rfind('.');
+    if (pos == std::string::npos) {
+        return false;
+    }
+
+    struct tm tm = {};
+    auto end = strptime(segmentPath.c_str() + pos + 1, SEGMENT_TIME_FORMAT, &tm);
+    if (!end || *end != '\0') {
+        return false;
+    }
+
+    start = timegm(&tm);
+    return true;
+}
+
+std::vector<std::string> listSegments(const std::string& sampleFilePath) {
+    auto paths = globArchives(sampleFilePath + ".[0-9]*");
+
+    time_t start;
+    paths.erase(std::remove_if(paths.begin(), paths.end(), [&](const std::string& path) {
+                    return !segmentStartTime(path, start);
+                }),
+                paths.end());
+
+    return paths;
+}
+
+std::vector<std::string> archivePaths(const std::string& path) {
+    if (isRegularFile(path)) {
+        return {path};
+    }
+
+    if (isDirectory(path)) {
+        std::vector<std::string> paths;
+        auto dir = opendir(path.c_str());
+        if (!dir) {
+            return paths;
+        }
+
+        while (auto entry = readdir(dir)) {
+            auto filePath = path + "/" + entry->d_name;
+            if (!isIndexFile(filePath) && isRegularFile(filePath)) {
+                paths.push_back(filePath);
+            }
+        }
+        closedir(dir);
+
+        // segment names sort by time
+        std::sort(paths.begin(), paths.end());
+        removeNonArchives(paths);
+        return paths;
+    }
+
+    if (path.find_first_of("*?[") != std::string::npos) {
+        auto paths = globArchives(path);
+        removeNonArchives(paths);
+        return paths;
+    }
+
+    return listSegments(path);
+}
+
+uint64_t archiveDiskUsage(const std::string& path) {
+    uint64_t size = 0;
+    struct stat st;
+    if (stat(path.c_str(), &st) == 0) {
+        size += st.st_size;
+    }
+    if (stat(indexFilePath(path).c_str(), &st) == 0) {
+        size += st.st_size;
+    }
+    return size;
+}
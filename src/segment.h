@@ -0,0 +1,26 @@
+#pragma once
+#include <stdint.h>
+#include <time.h>
+#include <string>
+#include <vector>
+
+// With rotation, a recording consists of segments named
+// <sample file>.<UTC start time as YYYYMMDD-HHMMSS>. Every segment starts
+// with a keyframe, so it can be read without the ones before it.
+
+std::string segmentFilePath(const std::string& sampleFilePath, time_t start);
+
+// start time encoded in the name of a segment
+bool segmentStartTime(const std::string& segmentPath, time_t& start);
+
+// all segments of a recording, oldest first
+std::vector<std::string> listSegments(const std::string& sampleFilePath);
+
+// Resolves what the user passed as sample file to the archives to load,
+// in order: a single archive, a directory of archives, a glob pattern or
+// the sample file path of a rotated recording. Files in a directory or
+// matching a pattern that do not start with an archive header are skipped.
+std::vector<std::string> archivePaths(const std::string& path);
+
+// size of an archive including its index file, 0 if it does not exist
+uint64_t archiveDiskUsage(const std::string& path);
@@ -0,0 +1,88 @@
+#include "sink.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+Sink::~Sink() {
+}
+
+FileSink::FileSink(int fd) : mFd(fd) {
+    struct stat st;
+    mSeekable = fstat(mFd, &st) == 0 && S_ISREG(st.st_mode);
+    if (mSeekable) {
+        auto offset = lseek(mFd, 0, SEEK_CUR);
+        mOffset = offset > 0 ? static_cast<uint64_t>(offset) : 0;
+    }
+}
+
+FileSink::~FileSink() {
+    close();
+}
+
+void FileSink::close() {
+    if (mFd >= 0) {
+        ::close(mFd);
+    }
+
+    mFd = -1;
+    mOffset = 0;
+    mSeekable = false;
+}
+
+bool FileSink::open(const std::string& path) {
+    close();
+
+    mFd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (mFd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    mSeekable = fstat(mFd, &st) == 0 && S_ISREG(st.st_mode);
+    return true;
+}
+
+bool FileSink::reopen(const std::string& path, uint64_t size) {
+    close();
+
+    mFd = ::open(path.c_str(), O_WRONLY | O_CLOEXEC);
+    if (mFd < 0) {
+        return false;
+    }
+
+    if (ftruncate(mFd, static_cast<off_t>(size)) != 0
+        || lseek(mFd, static_cast<off_t>(size), SEEK_SET) < 0) {
+        printf("failed to truncate %s (errno=%d)\n", path.c_str(), errno);
+        close();
+        return false;
+    }
+
+    mOffset = size;
+    mSeekable = true;
+    return true;
+}
+
+bool FileSink::write(std::string_view data) {
+    while (!data.empty()) {
+        auto res = ::write(mFd, data.data(), data.size());
+        if (res < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            printf("write failed (errno=%d)\n", errno);
+            return false;
+        }
+
+        mOffset += res;
+        data.remove_prefix(res);
+    }
+
+    return true;
+}
+
+bool MemorySink::write(std::string_view data) {
+    mData.append(data.data(), data.size());
+    return true;
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <string_view>
+
+// Destination of an encoded archive. The recorder hands over one complete
+// frame per write, so a sink never sees a partial sweep.
+class Sink {
+public:
+    virtual ~Sink();
+
+    virtual bool write(std::string_view data) = 0;
+
+    // number of bytes in the destination, i.e. the offset of the next write
+    virtual uint64_t offset() const = 0;
+
+    // false for destinations that cannot be read back, e.g. pipes
+    virtual bool isSeekable() const = 0;
+};
+
+// Regular file, FIFO or any other file descriptor.
+class FileSink : public Sink {
+public:
+    FileSink() = default;
+
+    // takes ownership of fd
+    explicit FileSink(int fd);
+
+    ~FileSink() override;
+
+    // creates or truncates path
+    bool open(const std::string& path);
+
+    // cuts path off after size bytes and appends to it
+    bool reopen(const std::string& path, uint64_t size);
+
+    bool write(std::string_view data) override;
+
+    uint64_t offset() const override { return mOffset; }
+
+    bool isSeekable() const override { return mSeekable; }
+
+private:
+    FileSink(const FileSink&) = delete;
+    void operator= (const FileSink&) = delete;
+
+    void close();
+
+    int mFd = -1;
+
+    uint64_t mOffset = 0;
+
+    bool mSeekable = false;
+};
+
+// Keeps everything in memory, e.g. to encode an archive without touching
+// the file system.
+class MemorySink : public Sink {
+public:
+    bool write(std::string_view data) override;
+
+    uint64_t offset() const override { return mData.size(); }
+
+    bool isSeekable() const override { return true; }
+
+    const std::string& data() const { return mData; }
+
+private:
+    std::string mData;
+};
@@ -1,9 +1,16 @@
 #include "snapshot.h"
 #include "common.h"
+#include "stringtable.h"
+#include "bytereader.h"
+#include "bytewriter.h"
+#include "procfs.h"
 #include <string.h>
 #include <inttypes.h>
 #include <time.h>
 #include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
 
 Snapshot::Snapshot(pid_t processId, int64_t timestamp) {
     mProcessId = processId;
@@ -14,18 +21,22 @@ Snapshot::~Snapshot() {
 }
 
 const Entry* Snapshot::findEntryByStartAddress(uint64_t startAddress) const {
-    for (const auto& it : mEntries) {
-        if (it.second.mFrom == startAddress) {
-            return &it.second;
-        }
+    // mEntries is keyed by start address, so this is a plain map lookup
+    auto it = mEntries.find(startAddress);
+    if (it == mEntries.end()) {
+        return nullptr;
     }
 
-    return nullptr;
+    return &it->second;
+}
+
+bool Snapshot::isRollup() const {
+    return mEntries.size() == 1 && mEntries.begin()->second.mKind == MappingKind::rollup;
 }
 
 // compares everything but the timestamp
 bool Snapshot::isEqualTo(const Snapshot& other) const {
-    if (mProcessId != other.mProcessId) {
+    if (identity() != other.identity()) {
         return false;
     }
 
@@ -33,6 +44,15 @@ bool Snapshot::isEqualTo(const Snapshot& other) const {
         return false;
     }
 
+    // both were parsed from identical smaps content
+    if (mContentHash != 0 && mContentHash == other.mContentHash) {
+        return true;
+    }
+
+    if (mEntries.size() != other.mEntries.size()) {
+        return false;
+    }
+
     auto it1 = mEntries.cbegin();
     auto it2 = other.mEntries.cbegin();
 
@@ -41,6 +61,12 @@ bool Snapshot::isEqualTo(const Snapshot& other) const {
             return false;
         }
 
+        if (it1->second.mHash != 0 && it1->second.mHash == it2->second.mHash) {
+            ++it1;
+            ++it2;
+            continue;
+        }
+
         if (it1->second != it2->second) {
             return false;
         }
@@ -52,89 +78,133 @@ bool Snapshot::isEqualTo(const Snapshot& other) const {
     return true;
 }
 
-std::string Snapshot::getProcessName() {
-    char buf[1024];
-    snprintf(buf, sizeof(buf), "/proc/%d/cmdline", mProcessId);
+void Snapshot::readProcessName() {
+    char path[128];
+    snprintf(path, sizeof(path), "/proc/%d/cmdline", mProcessId);
 
-    auto f = fopen(buf, "rb");
-    if (!f) {
-        return {};
+    // assigned to mName, a recycled snapshot keeps its capacity
+    mName.clear();
+    auto fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
     }
 
     char cmdLine[1024];
-    auto rd = fread(cmdLine, 1, sizeof(cmdLine) - 1, f);
+    auto rd = read(fd, cmdLine, sizeof(cmdLine) - 1);
+    close(fd);
     if (rd <= 0) {
-        fclose(f);
-        return {};
+        return;
     }
 
-    fclose(f);
-
+    // the arguments are separated by 0, only the first one is used
     cmdLine[rd] = 0;
-    return cmdLine;
+    mName.assign(cmdLine);
+}
+
+static bool isSpace(char c) {
+    return c == ' ' || c == '\t';
+}
+
+static void skipSpaces(std::string_view str, size_t& pos) {
+    while (pos < str.length() && isSpace(str[pos])) {
+        pos++;
+    }
+}
+
+static std::string_view nextField(std::string_view str, size_t& pos) {
+    skipSpaces(str, pos);
+    auto start = pos;
+    while (pos < str.length() && !isSpace(str[pos])) {
+        pos++;
+    }
+    return str.substr(start, pos - start);
 }
 
-bool Snapshot::parseHeadline(const std::string& headline, Entry& entry) {
+static int hexDigit(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+static bool parseHex(std::string_view str, size_t& pos, uint64_t& value) {
+    auto start = pos;
+    value = 0;
+    while (pos < str.length()) {
+        auto digit = hexDigit(str[pos]);
+        if (digit < 0) {
+            break;
+        }
+        value = (value << 4) | static_cast<uint64_t>(digit);
+        pos++;
+    }
+    return pos != start;
+}
+
+bool Snapshot::parseHeadline(std::string_view headline, Entry& entry) {
     // from-to                   permissions offset   device  inode      pathname
     // ffff0000-ffff1000         r-xp        00000000 00:00   0          [vectors]
     // 7fc9e2600000-7fc9e260d000 rw-p        00000000 00:00   0
-    char permissions[256];
-    char pathName[256];
-    char device[256];
-    int inode;
-
-    memset(pathName, 0, sizeof(pathName));
-
-    int rd = sscanf(headline.c_str(),
-                    "%" PRIx64 "-%" PRIx64 " %255s %" PRIx64 "  %255s %d %255s",
-                    &entry.mFrom,
-                    &entry.mTo,
-                    permissions,
-                    &entry.mOffset,
-                    device,
-                    &inode,
-                    pathName);
-
-    if (rd != 6 && rd != 7) {
-        printf("scanf: error reading headline (rd=%d)\n", rd);
+    size_t pos = 0;
+    if (!parseHex(headline, pos, entry.mFrom)
+        || pos >= headline.length()
+        || headline[pos++] != '-'
+        || !parseHex(headline, pos, entry.mTo)) {
+        printf("error reading address range of headline\n");
         return false;
     }
 
+    auto permissions = nextField(headline, pos);
+
+    skipSpaces(headline, pos);
+    if (!parseHex(headline, pos, entry.mOffset)) {
+        printf("error reading offset of headline\n");
+        return false;
+    }
+
+    auto device = nextField(headline, pos);
+    auto inode = nextField(headline, pos);
+    if (permissions.empty() || device.empty() || inode.empty()) {
+        printf("error reading headline\n");
+        return false;
+    }
+
+    // the path name is the rest of the line and may contain spaces
+    skipSpaces(headline, pos);
+    auto pathName = headline.substr(pos);
+    while (!pathName.empty() && isSpace(pathName.back())) {
+        pathName.remove_suffix(1);
+    }
+
     entry.mPermissions = permissions;
     entry.mDevice = device;
     entry.mPathName = pathName;
+    entry.mKind = Entry::classify(entry.mPathName);
 
     return true;
 }
 
-bool Snapshot::isHeadline(const std::string& str) {
-    uint64_t a, b;
-    auto count = sscanf(str.c_str(), "%" PRIx64 "-%" PRIx64 , &a, &b);
-    return count == 2;
-}
-
-std::string Snapshot::readLine(FILE* f) {
-    char* line = nullptr;
-    size_t lineLength;
-    auto rd = getline(&line, &lineLength, f);
-
-    std::string result;
-    if (rd > 0) {
-        result = line;
-    }
-
-    if (line) {
-        free(line);
+// headlines start with the hex start address followed by '-', value
+// lines start with a capitalized name followed by ':'
+bool Snapshot::isHeadline(std::string_view str) {
+    size_t pos = 0;
+    while (pos < str.length() && hexDigit(str[pos]) >= 0) {
+        pos++;
     }
-
-    return result;
+    return pos > 0 && pos < str.length() && str[pos] == '-';
 }
 
-// 1084 kB
-bool Snapshot::parseValue(const std::string& line, Entry& entry) {
+// Size:               1084 kB
+bool Snapshot::parseValue(std::string_view line, Entry& entry) {
     auto idx = line.find(':');
-    if (idx == std::string::npos) {
-        printf("missing : in value line \"%s\"\n", line.c_str());
+    if (idx == std::string_view::npos) {
+        printf("missing : in value line \"%.*s\"\n", static_cast<int>(line.length()), line.data());
         return false;
     }
 
@@ -143,43 +213,69 @@ bool Snapshot::parseValue(const std::string& line, Entry& entry) {
 
     auto result = entry.parseValue(name, valueAndUnit);
     if (result == Entry::ParseResult::error) {
-        printf("failed to parse valueAndUnit \'%s\' from line %s", valueAndUnit.c_str(), line.c_str());
+        printf("failed to parse valueAndUnit \'%.*s\' from line %.*s\n",
+               static_cast<int>(valueAndUnit.length()), valueAndUnit.data(),
+               static_cast<int>(line.length()), line.data());
     }
 
-
     return result != Entry::ParseResult::error;
 }
 
-bool Snapshot::writeToFileKilled(std::ofstream& stream) {
-    return writeUInt32(stream, 0xffffffff);
+bool Snapshot::writeToFileKilled(ByteWriter& writer) {
+    // pid 0 marks a killed process
+    writer.writeVarUInt64(0);
+    writer.writeVarUInt64(static_cast<uint32_t>(mProcessId));
+    writer.writeVarUInt64(mStartTime);
+    return true;
 }
 
-bool Snapshot::writeToFile(std::ofstream& stream, const Snapshot* prevSnapshot) {
+bool Snapshot::writeToFile(ByteWriter& writer, const Snapshot* prevSnapshot) {
 
     // process id
-    writeUInt32(stream, mProcessId);
+    writer.writeVarUInt64(static_cast<uint32_t>(mProcessId));
+    writer.writeVarUInt64(mStartTime);
 
     // write process name only for the first snapshot of this process
     if (!prevSnapshot) {
         // write name
-        writeString(stream, mName);
+        writer.writeVarString(mName);
+        startStringTable();
+    } else {
+        mStringTable = prevSnapshot->mStringTable;
     }
 
-    // write timestamp
-    writeUInt64(stream, mTimestamp);
+    // write timestamp relative to the previous one
+    int64_t prevTimestamp = prevSnapshot ? prevSnapshot->mTimestamp : 0;
+    writer.writeVarUInt64(zigzagEncode(mTimestamp - prevTimestamp));
 
     // count
-    int count = static_cast<int>(mEntries.size());
-    writeInt32(stream, count);
+    writer.writeVarUInt64(mEntries.size());
+
+    // both maps are sorted by start address, so walk them side by side
+    // instead of looking up every entry in the previous snapshot
+    std::map<uint64_t, Entry>::const_iterator prevIt;
+    if (prevSnapshot) {
+        prevIt = prevSnapshot->mEntries.cbegin();
+    }
 
+    uint64_t prevFrom = 0;
     for (const auto& it : mEntries) {
         const auto& entry = it.second;
         const Entry* prevEntry = nullptr;
         if (prevSnapshot) {
-            prevEntry = prevSnapshot->findEntryByStartAddress(entry.mFrom);
+            while (prevIt != prevSnapshot->mEntries.cend() && prevIt->first < entry.mFrom) {
+                ++prevIt;
+            }
+            if (prevIt != prevSnapshot->mEntries.cend() && prevIt->first == entry.mFrom) {
+                prevEntry = &prevIt->second;
+            }
         }
 
-        if (!entry.write(stream, prevEntry)) {
+        // start addresses are ascending, so store the distance to the last one
+        writer.writeVarUInt64(entry.mFrom - prevFrom);
+        prevFrom = entry.mFrom;
+
+        if (!entry.write(writer, prevEntry, *mStringTable)) {
             return false;
         }
     }
@@ -187,109 +283,370 @@ bool Snapshot::writeToFile(std::ofstream& stream, const Snapshot* prevSnapshot)
     return true;
 }
 
-Snapshot::ReadFileResult Snapshot::readFromFile(std::ifstream& stream, const std::map<pid_t, Snapshot*>& prevSnapshots) {
+Snapshot::ReadFileResult Snapshot::readFromFile(ByteReader& reader, uint32_t version, const std::map<ProcessIdentity, Snapshot*>& prevSnapshots) {
+    auto res = readIdentity(reader, version);
+    if (res != ReadFileResult::ok) {
+        return res;
+    }
+
+    auto it = prevSnapshots.find(identity());
+    return readEntries(reader, version, it != prevSnapshots.end() ? it->second : nullptr);
+}
+
+Snapshot::ReadFileResult Snapshot::readFromFile(ByteReader& reader, uint32_t version, const std::map<ProcessIdentity, std::unique_ptr<Snapshot>>& prevSnapshots) {
+    auto res = readIdentity(reader, version);
+    if (res != ReadFileResult::ok) {
+        return res;
+    }
+
+    auto it = prevSnapshots.find(identity());
+    return readEntries(reader, version, it != prevSnapshots.end() ? it->second.get() : nullptr);
+}
+
+void Snapshot::recycle() {
+    mProcessId = 0;
+    mStartTime = 0;
+    mName.clear();
+    mTimestamp = 0;
+    mUsage = Usage();
+    mContentHash = 0;
+
+    // keeps the larger set of nodes, the other one is freed
+    if (mEntries.size() > mSpareEntries.size()) {
+        mSpareEntries.swap(mEntries);
+    }
+    mEntries.clear();
+}
+
+void Snapshot::startStringTable() {
+    // the table of a recycled snapshot is reused unless the snapshot
+    // chain it belonged to is still alive
+    if (mStringTable && mStringTable.use_count() == 1) {
+        mStringTable->clear();
+    } else {
+        mStringTable = std::make_shared<StringTable>();
+    }
+}
+
+bool Snapshot::peekIdentity(ByteReader reader, uint32_t version, ProcessIdentity& identity) {
+    Snapshot snapshot;
+    if (snapshot.readIdentity(reader, version) == ReadFileResult::failed) {
+        return false;
+    }
+
+    identity = snapshot.identity();
+    return true;
+}
+
+void Snapshot::reset(pid_t processId, int64_t timestamp) {
+    recycle();
+    mProcessId = processId;
+    mTimestamp = timestamp;
+}
+
+std::map<uint64_t, Entry>::node_type Snapshot::spareEntry() {
+    if (mSpareEntries.empty()) {
+        mSpareEntries.emplace(0, Entry());
+    }
+    return mSpareEntries.extract(mSpareEntries.begin());
+}
+
+Snapshot::ReadFileResult Snapshot::readIdentity(ByteReader& reader, uint32_t version) {
     // process id
-    uint32_t pid;
-    readUInt32(stream, pid);
-    if (pid == 0xffffffff) {
-        // process is marked as killed
-        return ReadFileResult::killed;
+    uint64_t pid;
+    if (version == 1) {
+        uint32_t pid32;
+        if (!reader.readUInt32(pid32)) {
+            return ReadFileResult::failed;
+        }
+        if (pid32 == 0xffffffff) {
+            // process is marked as killed
+            return ReadFileResult::killed;
+        }
+        pid = pid32;
+    } else {
+        if (!reader.readVarUInt64(pid)) {
+            return ReadFileResult::failed;
+        }
+        if (pid == 0) {
+            // process is marked as killed
+            if (version >= 6
+                && (!reader.readVarUInt64(pid) || !reader.readVarUInt64(mStartTime))) {
+                return ReadFileResult::failed;
+            }
+            mProcessId = static_cast<pid_t>(pid);
+            return ReadFileResult::killed;
+        }
     }
     mProcessId = static_cast<pid_t>(pid);
 
-    const Snapshot* prevSnapshot = nullptr;
-    auto it = prevSnapshots.find(mProcessId);
-    if (it != prevSnapshots.end()) {
-        prevSnapshot = it->second;
+    if (version >= 6 && !reader.readVarUInt64(mStartTime)) {
+        return ReadFileResult::failed;
+    }
+
+    return ReadFileResult::ok;
+}
+
+Snapshot::ReadFileResult Snapshot::readEntries(ByteReader& reader, uint32_t version, const Snapshot* prevSnapshot) {
+    if (version == 1) {
+        return readEntriesV1(reader, prevSnapshot);
     }
 
     // read name
     if (!prevSnapshot) {
-        readString(stream, mName);
+        std::string_view name;
+        if (!reader.readVarString(name)) {
+            return ReadFileResult::failed;
+        }
+        mName = name;
+        startStringTable();
     } else {
         mName = prevSnapshot->mName;
+        mStringTable = prevSnapshot->mStringTable;
     }
 
     // timestamp
-    readInt64(stream, mTimestamp);
+    uint64_t timestampDelta;
+    if (!reader.readVarUInt64(timestampDelta)) {
+        return ReadFileResult::failed;
+    }
+    auto delta = zigzagDecode(timestampDelta);
+    if (version < 5) {
+        // seconds before version 5
+        delta *= 1000;
+    }
+    mTimestamp = (prevSnapshot ? prevSnapshot->mTimestamp : 0) + delta;
 
     // count
-    int count;
-    readInt32(stream, count);
+    uint64_t count;
+    if (!reader.readVarUInt64(count)) {
+        return ReadFileResult::failed;
+    }
+
+    std::map<uint64_t, Entry>::const_iterator prevIt;
+    if (prevSnapshot) {
+        prevIt = prevSnapshot->mEntries.cbegin();
+    }
+
+    // entries are written in ascending address order, so appending at the
+    // end of the map is amortized constant time
+    uint64_t prevFrom = 0;
+    for (uint64_t i = 0; i < count; i++) {
+        uint64_t fromDelta;
+        if (!reader.readVarUInt64(fromDelta)) {
+            return ReadFileResult::failed;
+        }
+
+        // decoded in place, the strings of a recycled entry keep their
+        // capacity
+        auto node = spareEntry();
+        auto& ent = node.mapped();
+        ent.reset();
+        ent.mFrom = prevFrom + fromDelta;
+        node.key() = ent.mFrom;
+        prevFrom = ent.mFrom;
+
+        const Entry* prevEntry = nullptr;
+        if (prevSnapshot) {
+            while (prevIt != prevSnapshot->mEntries.cend() && prevIt->first < ent.mFrom) {
+                ++prevIt;
+            }
+            if (prevIt != prevSnapshot->mEntries.cend() && prevIt->first == ent.mFrom) {
+                prevEntry = &prevIt->second;
+            }
+        }
+
+        if (!ent.read(reader, prevEntry, *mStringTable)) {
+            return ReadFileResult::failed;
+        }
+        mEntries.insert(mEntries.end(), std::move(node));
+    }
+
+    // the snapshot may be kept for long, unused nodes are not
+    mSpareEntries.clear();
+
+    updateUsage();
+    return ReadFileResult::ok;
+}
+
+Snapshot::ReadFileResult Snapshot::readEntriesV1(ByteReader& reader, const Snapshot* prevSnapshot) {
+    // read name
+    if (!prevSnapshot) {
+        std::string_view name;
+        if (!reader.readString(name)) {
+            return ReadFileResult::failed;
+        }
+        mName = name;
+    } else {
+        mName = prevSnapshot->mName;
+    }
+
+    // timestamp
+    int32_t count;
+    if (!reader.readInt64(mTimestamp) || !reader.readInt32(count)) {
+        return ReadFileResult::failed;
+    }
+    mTimestamp *= 1000;
 
+    // entries are written in ascending address order, so appending at the
+    // end of the map is amortized constant time
     for (int i = 0; i < count; i++) {
         Entry ent;
-        if (!ent.read(stream, prevSnapshot)) {
+        if (!ent.readV1(reader, prevSnapshot)) {
             return ReadFileResult::failed;
         }
-        mEntries[ent.mFrom] = ent;
+        mEntries.emplace_hint(mEntries.end(), ent.mFrom, std::move(ent));
     }
 
+    updateUsage();
     return ReadFileResult::ok;
 }
 
-int64_t Snapshot::calcHeapUsage() const {
-    int64_t heapUsage = 0;
+void Snapshot::updateUsage() {
+    mUsage = Usage();
     for (const auto& it : mEntries) {
         const auto& entry = it.second;
-        if (entry.mPathName == "[heap]") {
-            heapUsage += entry.mReferenced;
-        } else if (entry.mPathName.empty()) {
-            heapUsage += entry.mReferenced;
-        }
+        mUsage.mHeap += entry.heapUsage();
+        mUsage.mAnonymous += entry.mAnonymous;
+        mUsage.mRss += entry.mRss;
+        mUsage.mSwap += entry.mSwap;
+        mUsage.mPrivateDirty += entry.mPrivate_Dirty;
+        mUsage.mRssByKind[static_cast<size_t>(entry.mKind)] += entry.mRss;
     }
-
-    return heapUsage;
 }
 
-bool Snapshot::take() {
-    mName = getProcessName();
+bool Snapshot::take(Source source) {
+    if (!readStartTime(mProcessId, mStartTime)) {
+        printf("failed to read start time of process %d\n", mProcessId);
+        return false;
+    }
+
+    readProcessName();
 
     char path[128];
-    snprintf(path, sizeof(path), "/proc/%d/smaps", mProcessId);
+    if (source == Source::smapsRollup) {
+        snprintf(path, sizeof(path), "/proc/%d/smaps_rollup", mProcessId);
+    } else {
+        snprintf(path, sizeof(path), "/proc/%d/smaps", mProcessId);
+    }
 
-    auto f = fopen(path, "r");
-    if (!f) {
+    auto fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
         printf("failed to open %s\n", path);
         return false;
     }
 
-    bool result = true;
-    auto line = readLine(f);
-    while (!line.empty()) {
-        Entry entry;
-        if (!parseHeadline(line, entry)) {
-            result = false;
-            break;
+    // the buffer is kept across calls, so after the first few processes
+    // reading smaps does not allocate anymore
+    static thread_local std::vector<char> buffer(64 * 1024);
+
+    size_t size = 0;
+    while (true) {
+        if (size == buffer.size()) {
+            buffer.resize(buffer.size() * 2);
         }
 
-        while (true) {
-            line = readLine(f);
-            if (line.empty()) {
-                // end of file
-                break;
+        auto rd = read(fd, buffer.data() + size, buffer.size() - size);
+        if (rd < 0) {
+            if (errno == EINTR) {
+                continue;
             }
-            if (isHeadline(line)) {
-                break;
+            printf("failed to read %s (errno=%d)\n", path, errno);
+            close(fd);
+            return false;
+        }
+
+        if (rd == 0) {
+            break;
+        }
+
+        size += static_cast<size_t>(rd);
+    }
+
+    close(fd);
+
+    return parse(std::string_view(buffer.data(), size));
+}
+
+bool Snapshot::parse(std::string_view smaps) {
+    // entries are parsed into recycled nodes, see recycle()
+    std::map<uint64_t, Entry>::node_type node;
+    size_t entryStart = 0;
+
+    // every entry is hashed over its raw lines, the snapshot over the
+    // entry hashes, so unchanged processes and mappings can be detected
+    // without comparing fields
+    mContentHash = hashBytes(mName);
+
+    size_t pos = 0;
+    while (pos < smaps.length()) {
+        auto end = smaps.find('\n', pos);
+        if (end == std::string_view::npos) {
+            end = smaps.length();
+        }
+
+        auto lineStart = pos;
+        auto line = smaps.substr(pos, end - pos);
+        pos = end + 1;
+
+        if (line.empty()) {
+            continue;
+        }
+
+        if (isHeadline(line)) {
+            if (node) {
+                auto& entry = node.mapped();
+                entry.mHash = hashBytes(smaps.substr(entryStart, lineStart - entryStart));
+                mContentHash = combineHashes(mContentHash, entry.mHash);
+                addEntry(std::move(node));
             }
 
-            if (!parseValue(line, entry)) {
-                result = false;
-                break;
+            node = spareEntry();
+            node.mapped().reset();
+            if (!parseHeadline(line, node.mapped())) {
+                return false;
             }
+            entryStart = lineStart;
+            continue;
         }
-        if (!result) {
-            break;
+
+        if (!node) {
+            printf("value line before first headline\n");
+            return false;
         }
-        if (mEntries.find(entry.mFrom) != mEntries.end()) {
-            printf("found same start address twice %" PRIx64 "\n", entry.mFrom);
+
+        if (!parseValue(line, node.mapped())) {
+            return false;
         }
-        mEntries[entry.mFrom] = entry;
     }
 
-    fclose(f);
+    if (node) {
+        auto& entry = node.mapped();
+        entry.mHash = hashBytes(smaps.substr(entryStart));
+        mContentHash = combineHashes(mContentHash, entry.mHash);
+        addEntry(std::move(node));
+    }
+
+    // the snapshot may be kept for long, unused nodes are not
+    mSpareEntries.clear();
 
-    return result;
+    updateUsage();
+    return true;
 }
 
+void Snapshot::addEntry(std::map<uint64_t, Entry>::node_type&& node) {
+    auto from = node.mapped().mFrom;
+    node.key() = from;
+
+    // smaps is sorted by address, so new entries normally go to the end
+    if (mEntries.empty() || mEntries.rbegin()->first < from) {
+        mEntries.insert(mEntries.end(), std::move(node));
+        return;
+    }
 
+    auto res = mEntries.insert(std::move(node));
+    if (!res.inserted) {
+        printf("found same start address twice %" PRIx64 "\n", from);
+        res.position->second = std::move(res.node.mapped());
+    }
+}
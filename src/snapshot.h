@@ -1,15 +1,29 @@
 #pragma once
 #include "entry.h"
+#include "processidentity.h"
 #include <string>
+#include <string_view>
 #include <vector>
 #include <stdio.h>
 #include <stdint.h>
 #include <fstream>
 #include <map>
+#include <memory>
+
+class StringTable;
+class ByteReader;
+class ByteWriter;
 
 // Contains entries for one process at one point in time
 class Snapshot {
 public:
+    enum class Source {
+        // one entry per mapping from /proc/<pid>/smaps
+        smaps,
+        // a single aggregated entry from /proc/<pid>/smaps_rollup
+        smapsRollup,
+    };
+
     enum class ReadFileResult {
         ok,
         failed,
@@ -24,23 +38,61 @@ public:
 
     pid_t processId() const { return mProcessId; }
 
+    ProcessIdentity identity() const { return {mProcessId, mStartTime}; }
+
+    // milliseconds since the epoch
     int64_t timestamp() const { return mTimestamp; }
 
     const std::string& name() const { return mName; }
 
-    bool writeToFileKilled(std::ofstream& stream);
+    // marks the process of this snapshot as ended
+    bool writeToFileKilled(ByteWriter& writer);
+
+    bool writeToFile(ByteWriter& writer, const Snapshot* prevSnapshot);
+
+    // killed markers of version 6 and later set the identity of the
+    // ended process
+    ReadFileResult readFromFile(ByteReader& reader, uint32_t version, const std::map<ProcessIdentity, Snapshot*>& prevSnapshots);
 
-    bool writeToFile(std::ofstream& stream, const Snapshot* prevSnapshot);
+    ReadFileResult readFromFile(ByteReader& reader, uint32_t version, const std::map<ProcessIdentity, std::unique_ptr<Snapshot>>& prevSnapshots);
 
-    ReadFileResult readFromFile(std::ifstream& stream, const std::map<pid_t, Snapshot*>& prevSnapshots);
+    // empties the snapshot so the next one can be read into it, the
+    // memory of its entries and string table is reused
+    void recycle();
+
+    // the identity of the next snapshot in reader, reader is not advanced
+    static bool peekIdentity(ByteReader reader, uint32_t version, ProcessIdentity& identity);
+
+    // recycles the snapshot for taking a new one of the process
+    void reset(pid_t processId, int64_t timestamp);
 
     const std::map<uint64_t, Entry>& entries() { return mEntries; }
 
     const std::map<uint64_t, Entry>& entries() const { return mEntries; }
 
-    bool take();
+    bool take(Source source = Source::smaps);
+
+    // parses the content of a smaps file into entries
+    bool parse(std::string_view smaps);
+
+    // memory usage in kB, summed over all entries
+    struct Usage {
+        // see Entry::heapUsage()
+        int64_t mHeap = 0;
+        int64_t mAnonymous = 0;
+        int64_t mRss = 0;
+        int64_t mSwap = 0;
+        int64_t mPrivateDirty = 0;
+        int64_t mRssByKind[static_cast<size_t>(MappingKind::count)] = {};
+    };
+
+    // computed once when the snapshot is taken or read
+    const Usage& usage() const { return mUsage; }
 
-    int64_t calcHeapUsage() const;
+    int64_t heapUsage() const { return mUsage.mHeap; }
+
+    // taken from smaps_rollup, a single entry for the whole process
+    bool isRollup() const;
 
     const Entry* findEntryByStartAddress(uint64_t startAddress) const;
 
@@ -50,22 +102,53 @@ private:
     Snapshot(const Snapshot&) = delete;
     void operator= (const Snapshot&) = delete;
 
-    static std::string readLine(FILE* f);
+    // reads the process id and start time
+    ReadFileResult readIdentity(ByteReader& reader, uint32_t version);
+
+    ReadFileResult readEntries(ByteReader& reader, uint32_t version, const Snapshot* prevSnapshot);
+
+    ReadFileResult readEntriesV1(ByteReader& reader, const Snapshot* prevSnapshot);
+
+    // a new string table for a snapshot without delta base
+    void startStringTable();
+
+    // an entry node from mSpareEntries or a new one
+    std::map<uint64_t, Entry>::node_type spareEntry();
+
+    void addEntry(std::map<uint64_t, Entry>::node_type&& node);
 
-    static bool parseValue(const std::string& line, Entry& entry);
+    void updateUsage();
 
-    static bool parseHeadline(const std::string& headline, Entry& entry);
+    static bool parseValue(std::string_view line, Entry& entry);
 
-    static bool isHeadline(const std::string& str);
+    static bool parseHeadline(std::string_view headline, Entry& entry);
 
-    std::string getProcessName();
+    static bool isHeadline(std::string_view str);
+
+    // sets mName from /proc/<pid>/cmdline
+    void readProcessName();
 
     pid_t mProcessId = 0;
 
+    uint64_t mStartTime = 0;
+
     std::string mName;
 
     int64_t mTimestamp = 0;
 
     // entries by start address
     std::map<uint64_t, Entry> mEntries;
+
+    // entries of the recycled snapshot, taken over by readFromFile()
+    std::map<uint64_t, Entry> mSpareEntries;
+
+    Usage mUsage;
+
+    // hash of the parsed smaps content and name, 0 for snapshots read
+    // from an archive
+    uint64_t mContentHash = 0;
+
+    // strings of this process' snapshot chain in the archive, shared with
+    // the previous snapshot of the same process
+    std::shared_ptr<StringTable> mStringTable;
 };
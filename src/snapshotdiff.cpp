@@ -0,0 +1,215 @@
+#include "snapshotdiff.h"
+#include "snapshot.h"
+#include <algorithm>
+
+// mappings whose start address changes when they grow or move
+static bool isMovable(const Entry& entry) {
+    return entry.mKind == MappingKind::heap
+        || entry.mKind == MappingKind::anonymous
+        || entry.mKind == MappingKind::stack;
+}
+
+static bool isSameRegion(const Entry& a, const Entry& b) {
+    return isMovable(a)
+        && a.mKind == b.mKind
+        && a.mPathName == b.mPathName;
+}
+
+template <typename T>
+static bool growsMore(const T& a, const T& b) {
+    if (a.mHeap != b.mHeap) {
+        return a.mHeap > b.mHeap;
+    }
+    return a.mRss > b.mRss;
+}
+
+std::string_view SnapshotDiff::displayName(const Entry& entry) {
+    if (entry.mPathName.empty()) {
+        return "[anonymous]";
+    }
+    return entry.mPathName;
+}
+
+void SnapshotDiff::compute(const Snapshot& from, const Snapshot& to, bool anonymous) {
+    mAnonymous = anonymous;
+    mChanges.clear();
+    mRemoved.clear();
+    mAdded.clear();
+    mHeap = 0;
+    mRss = 0;
+
+    // both are ordered by start address
+    auto fromIt = from.entries().cbegin();
+    auto fromEnd = from.entries().cend();
+    auto toIt = to.entries().cbegin();
+    auto toEnd = to.entries().cend();
+    while (fromIt != fromEnd || toIt != toEnd) {
+        if (toIt == toEnd || (fromIt != fromEnd && fromIt->first < toIt->first)) {
+            mRemoved.push_back(&fromIt->second);
+            ++fromIt;
+        } else if (fromIt == fromEnd || toIt->first < fromIt->first) {
+            mAdded.push_back(&toIt->second);
+            ++toIt;
+        } else {
+            addChange(&fromIt->second, &toIt->second);
+            ++fromIt;
+            ++toIt;
+        }
+    }
+
+    if (!mRemoved.empty() && !mAdded.empty()) {
+        matchOverlapping();
+        matchMoved();
+    }
+
+    for (auto entry : mRemoved) {
+        addChange(entry, nullptr);
+    }
+    for (auto entry : mAdded) {
+        addChange(nullptr, entry);
+    }
+
+    std::sort(mChanges.begin(), mChanges.end(), growsMore<Change>);
+    groupChanges();
+}
+
+int64_t SnapshotDiff::heapUsage(const Entry* entry) const {
+    if (!entry) {
+        return 0;
+    }
+    return mAnonymous ? static_cast<int64_t>(entry->mAnonymous) : entry->heapUsage();
+}
+
+void SnapshotDiff::addChange(const Entry* from, const Entry* to) {
+    int64_t heap = heapUsage(to) - heapUsage(from);
+    int64_t rss = static_cast<int64_t>(to ? to->mRss : 0) - static_cast<int64_t>(from ? from->mRss : 0);
+    mHeap += heap;
+    mRss += rss;
+
+    if (from && to && heap == 0 && rss == 0 && from->mTo == to->mTo) {
+        return;
+    }
+
+    mChanges.push_back({from, to, heap, rss});
+}
+
+// A stack or an arena growing downwards or shrinking from the front keeps
+// part of its address range. Both lists are in address order, so one pass
+// finds all overlaps.
+void SnapshotDiff::matchOverlapping() {
+    size_t removedIndex = 0;
+    size_t addedIndex = 0;
+    while (removedIndex < mRemoved.size() && addedIndex < mAdded.size()) {
+        auto removed = mRemoved[removedIndex];
+        auto added = mAdded[addedIndex];
+        if (removed->mFrom < added->mTo
+            && added->mFrom < removed->mTo
+            && isSameRegion(*removed, *added)) {
+            addChange(removed, added);
+            mRemoved[removedIndex++] = nullptr;
+            mAdded[addedIndex++] = nullptr;
+            continue;
+        }
+
+        if (removed->mTo <= added->mTo) {
+            removedIndex++;
+        } else {
+            addedIndex++;
+        }
+    }
+
+    mRemoved.erase(std::remove(mRemoved.begin(), mRemoved.end(), nullptr), mRemoved.end());
+    mAdded.erase(std::remove(mAdded.begin(), mAdded.end(), nullptr), mAdded.end());
+}
+
+// mremap() moves a mapping to a new address with the same size
+void SnapshotDiff::matchMoved() {
+    auto less = [](const Entry* a, const Entry* b) {
+        if (a->mKind != b->mKind) {
+            return a->mKind < b->mKind;
+        }
+        if (a->mTo - a->mFrom != b->mTo - b->mFrom) {
+            return a->mTo - a->mFrom < b->mTo - b->mFrom;
+        }
+        if (a->mPathName != b->mPathName) {
+            return a->mPathName < b->mPathName;
+        }
+        return a->mFrom < b->mFrom;
+    };
+
+    std::sort(mRemoved.begin(), mRemoved.end(), less);
+    std::sort(mAdded.begin(), mAdded.end(), less);
+
+    size_t removedIndex = 0;
+    size_t addedIndex = 0;
+    while (removedIndex < mRemoved.size() && addedIndex < mAdded.size()) {
+        auto removed = mRemoved[removedIndex];
+        auto added = mAdded[addedIndex];
+        if (removed->mTo - removed->mFrom == added->mTo - added->mFrom
+            && isSameRegion(*removed, *added)) {
+            addChange(removed, added);
+            mRemoved[removedIndex++] = nullptr;
+            mAdded[addedIndex++] = nullptr;
+            continue;
+        }
+
+        // advance the smaller one, mappings that cannot move are told
+        // apart by address
+        if (less(removed, added)) {
+            removedIndex++;
+        } else {
+            addedIndex++;
+        }
+    }
+
+    mRemoved.erase(std::remove(mRemoved.begin(), mRemoved.end(), nullptr), mRemoved.end());
+    mAdded.erase(std::remove(mAdded.begin(), mAdded.end(), nullptr), mAdded.end());
+}
+
+void SnapshotDiff::groupChanges() {
+    mPaths.clear();
+    mKinds.clear();
+
+    Group kinds[static_cast<size_t>(MappingKind::count)];
+    for (const auto& change : mChanges) {
+        const auto& entry = change.mTo ? *change.mTo : *change.mFrom;
+
+        Group group;
+        group.mName = displayName(entry);
+        group.mHeap = change.mHeap;
+        group.mRss = change.mRss;
+        group.mMappings = 1;
+        mPaths.push_back(group);
+
+        auto& kind = kinds[static_cast<size_t>(entry.mKind)];
+        kind.mHeap += change.mHeap;
+        kind.mRss += change.mRss;
+        kind.mMappings++;
+    }
+
+    // merge the changes of the same path
+    std::sort(mPaths.begin(), mPaths.end(), [](const Group& a, const Group& b) {
+        return a.mName < b.mName;
+    });
+    size_t count = 0;
+    for (size_t i = 0; i < mPaths.size(); i++) {
+        if (count > 0 && mPaths[count - 1].mName == mPaths[i].mName) {
+            auto& group = mPaths[count - 1];
+            group.mHeap += mPaths[i].mHeap;
+            group.mRss += mPaths[i].mRss;
+            group.mMappings += mPaths[i].mMappings;
+        } else {
+            mPaths[count++] = mPaths[i];
+        }
+    }
+    mPaths.resize(count);
+    std::sort(mPaths.begin(), mPaths.end(), growsMore<Group>);
+
+    for (size_t i = 0; i < static_cast<size_t>(MappingKind::count); i++) {
+        if (kinds[i].mMappings > 0) {
+            kinds[i].mName = Entry::kindName(static_cast<MappingKind>(i));
+            mKinds.push_back(kinds[i]);
+        }
+    }
+    std::sort(mKinds.begin(), mKinds.end(), growsMore<Group>);
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include "entry.h"
+#include <string_view>
+#include <vector>
+#include <stdint.h>
+
+class Snapshot;
+
+// Where the memory of a process changed between two of its snapshots.
+// Mappings are matched by start address, anonymous mappings that moved or
+// grew downwards by overlap or size. compute() reuses its buffers, so it
+// is cheap enough to run over every pair of consecutive snapshots.
+class SnapshotDiff {
+public:
+    // a mapping in both snapshots, only in the newer one (mFrom is null)
+    // or only in the older one (mTo is null)
+    struct Change {
+        const Entry* mFrom;
+        const Entry* mTo;
+
+        // in kB
+        int64_t mHeap;
+        int64_t mRss;
+    };
+
+    // changes summed up by path name or by mapping kind
+    struct Group {
+        // points into the entries or is a static name
+        std::string_view mName;
+        int64_t mHeap = 0;
+        int64_t mRss = 0;
+        // number of changed mappings
+        int mMappings = 0;
+    };
+
+    // the snapshots have to outlive the results, anonymous counts the
+    // anonymous memory of every mapping as heap, see Process::heapUsage()
+    void compute(const Snapshot& from, const Snapshot& to, bool anonymous);
+
+    // all sorted by heap growth, then by rss growth
+    const std::vector<Change>& changes() const { return mChanges; }
+
+    const std::vector<Group>& paths() const { return mPaths; }
+
+    const std::vector<Group>& kinds() const { return mKinds; }
+
+    int64_t heapDelta() const { return mHeap; }
+
+    int64_t rssDelta() const { return mRss; }
+
+    // the path name, or a placeholder for anonymous mappings
+    static std::string_view displayName(const Entry& entry);
+
+private:
+    void addChange(const Entry* from, const Entry* to);
+
+    int64_t heapUsage(const Entry* entry) const;
+
+    // pairs up the unmatched mappings in mRemoved and mAdded
+    void matchOverlapping();
+
+    void matchMoved();
+
+    void groupChanges();
+
+    std::vector<Change> mChanges;
+
+    // mappings without a match at the same start address, in address order
+    std::vector<const Entry*> mRemoved;
+    std::vector<const Entry*> mAdded;
+
+    std::vector<Group> mPaths;
+    std::vector<Group> mKinds;
+
+    int64_t mHeap = 0;
+    int64_t mRss = 0;
+
+    bool mAnonymous = false;
+};
@@ -0,0 +1,39 @@
+#include "stringtable.h"
+
+uint32_t StringTable::find(const std::string& value) {
+    for (; mIndexedSize < mSize; mIndexedSize++) {
+        mIndices.emplace(mStrings[mIndexedSize], static_cast<uint32_t>(mIndexedSize));
+    }
+
+    auto it = mIndices.find(value);
+    if (it == mIndices.end()) {
+        return static_cast<uint32_t>(mSize);
+    }
+
+    return it->second;
+}
+
+const std::string* StringTable::at(uint32_t index) const {
+    if (index >= mSize) {
+        return nullptr;
+    }
+
+    return &mStrings[index];
+}
+
+uint32_t StringTable::add(std::string_view value) {
+    auto index = static_cast<uint32_t>(mSize);
+    if (mSize < mStrings.size()) {
+        mStrings[mSize].assign(value);
+    } else {
+        mStrings.emplace_back(value);
+    }
+    mSize++;
+    return index;
+}
+
+void StringTable::clear() {
+    mSize = 0;
+    mIndices.clear();
+    mIndexedSize = 0;
+}
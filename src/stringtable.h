@@ -0,0 +1,36 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Strings that were already written to (or read from) an archive, so that
+// repeated path names, devices and permissions can be referenced by index.
+// Writer and reader build up identical tables while processing the same
+// sequence of snapshots.
+class StringTable {
+public:
+    size_t size() const { return mSize; }
+
+    // returns the index of value, or size() if it is not in the table yet
+    uint32_t find(const std::string& value);
+
+    const std::string* at(uint32_t index) const;
+
+    uint32_t add(std::string_view value);
+
+    // empties the table, add() reuses the memory of the strings
+    void clear();
+
+private:
+    // the first mSize strings are in use
+    std::vector<std::string> mStrings;
+
+    size_t mSize = 0;
+
+    // only needed for writing, so it is built by find() and not by add()
+    std::unordered_map<std::string, uint32_t> mIndices;
+
+    size_t mIndexedSize = 0;
+};
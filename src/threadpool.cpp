@@ -0,0 +1,59 @@
+#include "threadpool.h"
+
+ThreadPool::ThreadPool(int threadCount) {
+    for (int i = 0; i < threadCount; i++) {
+        mThreads.emplace_back([this] { run(); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStop = true;
+    }
+    mTaskAvailable.notify_all();
+
+    for (auto& thread : mThreads) {
+        thread.join();
+    }
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mTasks.push_back(std::move(task));
+    }
+    mTaskAvailable.notify_one();
+}
+
+void ThreadPool::wait() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mTasksDone.wait(lock, [this] { return mTasks.empty() && mRunningCount == 0; });
+}
+
+void ThreadPool::run() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mTaskAvailable.wait(lock, [this] { return mStop || !mTasks.empty(); });
+            if (mTasks.empty()) {
+                return;
+            }
+
+            task = std::move(mTasks.front());
+            mTasks.pop_front();
+            mRunningCount++;
+        }
+
+        task();
+
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mRunningCount--;
+            if (mTasks.empty() && mRunningCount == 0) {
+                mTasksDone.notify_all();
+            }
+        }
+    }
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads processing a shared task queue.
+//
+// There is no work stealing on purpose. The tasks are coarse: one process
+// per task while recording, and keyframe chunks of at least 256kB while
+// loading, of which only twice the thread count are in flight. Either
+// takes far longer than the lock around the queue. The loader also
+// consumes chunks in file order, which a first in, first out queue
+// decodes in that same order, while per-worker deques would not.
+class ThreadPool {
+public:
+    explicit ThreadPool(int threadCount);
+
+    ~ThreadPool();
+
+    int threadCount() const { return static_cast<int>(mThreads.size()); }
+
+    void submit(std::function<void()> task);
+
+    // blocks until all submitted tasks have finished
+    void wait();
+
+private:
+    ThreadPool(const ThreadPool&) = delete;
+    void operator= (const ThreadPool&) = delete;
+
+    void run();
+
+    std::vector<std::thread> mThreads;
+
+    std::deque<std::function<void()>> mTasks;
+
+    std::mutex mMutex;
+
+    std::condition_variable mTaskAvailable;
+
+    std::condition_variable mTasksDone;
+
+    int mRunningCount = 0;
+
+    bool mStop = false;
+};
@@ -0,0 +1,193 @@
+#include "timeseries.h"
+#include "snapshot.h"
+#include <algorithm>
+
+using ValueMember = uint64_t Entry::*;
+
+static const std::array<ValueMember, TimeSeries::FIELD_COUNT>& valueMembers() {
+    static const std::array<ValueMember, TimeSeries::FIELD_COUNT> members = {
+        &Entry::mSize,
+        &Entry::mKernelPageSize,
+        &Entry::mMMUPageSize,
+        &Entry::mRss,
+        &Entry::mShared_Clean,
+        &Entry::mShared_Dirty,
+        &Entry::mPrivate_Clean,
+        &Entry::mPrivate_Dirty,
+        &Entry::mReferenced,
+        &Entry::mAnonymous,
+        &Entry::mKSM,
+        &Entry::mLazyFree,
+        &Entry::mAnonHugePages,
+        &Entry::mShmemPmdMapped,
+        &Entry::mShared_Hugetlb,
+        &Entry::mPrivate_Hugetlb,
+        &Entry::mSwap,
+        &Entry::mSwapPss,
+        &Entry::mLocked,
+        &Entry::mFilePmdMapped,
+    };
+
+    return members;
+}
+
+int TimeSeries::fieldIndex(uint64_t Entry::* field) {
+    const auto& members = valueMembers();
+    for (size_t i = 0; i < members.size(); i++) {
+        if (members[i] == field) {
+            return static_cast<int>(i);
+        }
+    }
+
+    return -1;
+}
+
+const TimeSeries::Column* TimeSeries::column(uint64_t Entry::* field) const {
+    auto index = fieldIndex(field);
+    if (index < 0) {
+        return nullptr;
+    }
+
+    return &mColumns[index];
+}
+
+const std::string* TimeSeries::intern(const std::string& str) {
+    return &*mStrings.insert(str).first;
+}
+
+static bool isSameMapping(const TimeSeries::Mapping& mapping, const Entry& entry) {
+    return mapping.mTo == entry.mTo
+        && mapping.mOffset == entry.mOffset
+        && *mapping.mPermissions == entry.mPermissions
+        && *mapping.mDevice == entry.mDevice
+        && *mapping.mPathName == entry.mPathName;
+}
+
+void TimeSeries::setValue(LiveMapping& live, size_t field, uint64_t value, uint32_t sample) {
+    if (live.mValues[field] == value) {
+        return;
+    }
+
+    live.mValues[field] = value;
+
+    auto& column = mColumns[field];
+    column.mSamples.push_back(sample);
+    column.mMappings.push_back(live.mIndex);
+    column.mValues.push_back(value);
+}
+
+uint32_t TimeSeries::startMapping(const Entry& entry, uint32_t sample) {
+    Mapping mapping;
+    mapping.mFrom = entry.mFrom;
+    mapping.mTo = entry.mTo;
+    mapping.mOffset = entry.mOffset;
+    mapping.mPermissions = intern(entry.mPermissions);
+    mapping.mDevice = intern(entry.mDevice);
+    mapping.mPathName = intern(entry.mPathName);
+    mapping.mKind = entry.mKind;
+    mapping.mFirstSample = sample;
+    mapping.mEndSample = sample;
+
+    mMappings.push_back(mapping);
+    return static_cast<uint32_t>(mMappings.size() - 1);
+}
+
+void TimeSeries::endMapping(LiveMapping& live, uint32_t sample) {
+    mMappings[live.mIndex].mEndSample = sample;
+    for (size_t field = 0; field < FIELD_COUNT; field++) {
+        setValue(live, field, 0, sample);
+    }
+}
+
+void TimeSeries::append(const Snapshot& snapshot) {
+    auto sample = static_cast<uint32_t>(mTimestamps.size());
+    mTimestamps.push_back(snapshot.timestamp());
+
+    const auto& members = valueMembers();
+
+    // both are sorted by start address
+    auto liveIt = mLive.begin();
+    for (const auto& it : snapshot.entries()) {
+        const auto& entry = it.second;
+
+        while (liveIt != mLive.end() && liveIt->first < entry.mFrom) {
+            endMapping(liveIt->second, sample);
+            liveIt = mLive.erase(liveIt);
+        }
+
+        if (liveIt != mLive.end()
+            && liveIt->first == entry.mFrom
+            && !isSameMapping(mMappings[liveIt->second.mIndex], entry)) {
+            endMapping(liveIt->second, sample);
+            liveIt = mLive.erase(liveIt);
+        }
+
+        if (liveIt == mLive.end() || liveIt->first != entry.mFrom) {
+            LiveMapping live;
+            live.mIndex = startMapping(entry, sample);
+            live.mValues.fill(0);
+            liveIt = mLive.emplace_hint(liveIt, entry.mFrom, live);
+        }
+
+        for (size_t field = 0; field < FIELD_COUNT; field++) {
+            setValue(liveIt->second, field, entry.*members[field], sample);
+        }
+        mMappings[liveIt->second.mIndex].mEndSample = sample + 1;
+
+        ++liveIt;
+    }
+
+    while (liveIt != mLive.end()) {
+        endMapping(liveIt->second, sample);
+        liveIt = mLive.erase(liveIt);
+    }
+}
+
+std::vector<int64_t> TimeSeries::sumPerSample(uint64_t Entry::* field, Filter filter) const {
+    std::vector<int64_t> sums(mTimestamps.size(), 0);
+
+    auto col = column(field);
+    if (!col) {
+        return sums;
+    }
+
+    std::vector<char> accepted(mMappings.size());
+    for (size_t i = 0; i < mMappings.size(); i++) {
+        accepted[i] = filter(mMappings[i]) ? 1 : 0;
+    }
+
+    std::vector<uint64_t> values(mMappings.size(), 0);
+    int64_t sum = 0;
+    size_t change = 0;
+    for (uint32_t sample = 0; sample < sums.size(); sample++) {
+        while (change < col->mSamples.size() && col->mSamples[change] == sample) {
+            auto mapping = col->mMappings[change];
+            auto value = col->mValues[change];
+            if (accepted[mapping]) {
+                sum += static_cast<int64_t>(value) - static_cast<int64_t>(values[mapping]);
+            }
+            values[mapping] = value;
+            change++;
+        }
+        sums[sample] = sum;
+    }
+
+    return sums;
+}
+
+std::vector<int64_t> TimeSeries::heapUsagePerSample() const {
+    // a process recorded from smaps_rollup keeps counting anonymous memory
+    // after it was upgraded to full smaps, see Process::heapUsage()
+    bool rollup = std::any_of(mMappings.begin(), mMappings.end(), [](const Mapping& mapping) {
+        return mapping.mKind == MappingKind::rollup;
+    });
+    if (rollup) {
+        return sumPerSample(&Entry::mAnonymous, [](const Mapping&) {
+            return true;
+        });
+    }
+
+    return sumPerSample(&Entry::mReferenced, [](const Mapping& mapping) {
+        return mapping.mKind == MappingKind::heap || mapping.mKind == MappingKind::anonymous;
+    });
+}
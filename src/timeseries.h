@@ -0,0 +1,88 @@
+#pragma once
+#include "entry.h"
+#include <array>
+#include <map>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+class Snapshot;
+
+// All snapshots of one process in columnar form. Mapping metadata is
+// stored once per mapping, and for every value field only the changes are
+// kept, so memory grows with the number of changes rather than with the
+// number of snapshots times the number of mappings.
+class TimeSeries {
+public:
+    static constexpr size_t FIELD_COUNT = 20;
+
+    struct Mapping {
+        uint64_t mFrom = 0;
+        uint64_t mTo = 0;
+        uint64_t mOffset = 0;
+
+        // interned, see mStrings
+        const std::string* mPermissions = nullptr;
+        const std::string* mDevice = nullptr;
+        const std::string* mPathName = nullptr;
+        MappingKind mKind = MappingKind::anonymous;
+
+        // the mapping exists in samples [mFirstSample, mEndSample)
+        uint32_t mFirstSample = 0;
+        uint32_t mEndSample = 0;
+    };
+
+    // Changes of one value field of all mappings, ordered by sample. A
+    // mapping's value is 0 before its first change and after it ended.
+    struct Column {
+        std::vector<uint32_t> mSamples;
+        std::vector<uint32_t> mMappings;
+        std::vector<uint64_t> mValues;
+    };
+
+    using Filter = bool (*)(const Mapping& mapping);
+
+    // snapshots have to be appended in timestamp order
+    void append(const Snapshot& snapshot);
+
+    size_t sampleCount() const { return mTimestamps.size(); }
+
+    const std::vector<int64_t>& timestamps() const { return mTimestamps; }
+
+    const std::vector<Mapping>& mappings() const { return mMappings; }
+
+    const Column* column(uint64_t Entry::* field) const;
+
+    // sum of a field over all mappings accepted by filter, per sample
+    std::vector<int64_t> sumPerSample(uint64_t Entry::* field, Filter filter) const;
+
+    // same as Process::heapUsage() for every sample
+    std::vector<int64_t> heapUsagePerSample() const;
+
+private:
+    struct LiveMapping {
+        uint32_t mIndex;
+        std::array<uint64_t, FIELD_COUNT> mValues;
+    };
+
+    static int fieldIndex(uint64_t Entry::* field);
+
+    const std::string* intern(const std::string& str);
+
+    uint32_t startMapping(const Entry& entry, uint32_t sample);
+
+    void endMapping(LiveMapping& live, uint32_t sample);
+
+    void setValue(LiveMapping& live, size_t field, uint64_t value, uint32_t sample);
+
+    std::vector<int64_t> mTimestamps;
+
+    std::vector<Mapping> mMappings;
+
+    std::array<Column, FIELD_COUNT> mColumns;
+
+    // mappings present in the last appended snapshot by start address
+    std::map<uint64_t, LiveMapping> mLive;
+
+    std::unordered_set<std::string> mStrings;
+};
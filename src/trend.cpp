@@ -0,0 +1,97 @@
+#include "trend.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+void Trend::add(int64_t timestamp, double value) {
+    if (mCount == 0) {
+        mOrigin = timestamp;
+    } else if (value > mLastValue) {
+        mIncreases++;
+    } else if (value < mLastValue) {
+        mDecreases++;
+    }
+    mLastValue = value;
+
+    double time = static_cast<double>(timestamp - mOrigin);
+    if (mCount % mStride == 0) {
+        if (mPointCount == RESERVOIR_SIZE) {
+            for (size_t i = 0; i < RESERVOIR_SIZE / 2; i++) {
+                mPoints[i] = mPoints[i * 2];
+            }
+            mPointCount = RESERVOIR_SIZE / 2;
+            mStride *= 2;
+        }
+
+        if (mCount % mStride == 0) {
+            mPoints[mPointCount++] = {time, value};
+        }
+    }
+
+    mCount++;
+    double dt = time - mMeanTime;
+    mMeanTime += dt / mCount;
+    double dv = value - mMeanValue;
+    mMeanValue += dv / mCount;
+    mSxx += dt * (time - mMeanTime);
+    mSxy += dt * (value - mMeanValue);
+    mSyy += dv * (value - mMeanValue);
+}
+
+double Trend::slope() const {
+    if (mSxx <= 0) {
+        return 0;
+    }
+    return mSxy / mSxx;
+}
+
+double Trend::slopeError() const {
+    if (mCount < 3 || mSxx <= 0) {
+        return 0;
+    }
+
+    double residual = std::max(0.0, mSyy - slope() * mSxy);
+    return std::sqrt(residual / (mCount - 2) / mSxx);
+}
+
+double Trend::rSquared() const {
+    if (mSxx <= 0 || mSyy <= 0) {
+        return 0;
+    }
+    return mSxy * mSxy / (mSxx * mSyy);
+}
+
+double Trend::robustSlope() const {
+    std::vector<double> slopes;
+    slopes.reserve(mPointCount * (mPointCount - 1) / 2);
+    for (size_t i = 0; i < mPointCount; i++) {
+        for (size_t j = i + 1; j < mPointCount; j++) {
+            auto dt = mPoints[j].mTime - mPoints[i].mTime;
+            if (dt > 0) {
+                slopes.push_back((mPoints[j].mValue - mPoints[i].mValue) / dt);
+            }
+        }
+    }
+
+    if (slopes.empty()) {
+        return 0;
+    }
+
+    auto middle = slopes.begin() + slopes.size() / 2;
+    std::nth_element(slopes.begin(), middle, slopes.end());
+    if (slopes.size() % 2 == 1) {
+        return *middle;
+    }
+
+    // the lower middle is the largest value before middle
+    auto lower = *std::max_element(slopes.begin(), middle);
+    return (lower + *middle) / 2;
+}
+
+double Trend::monotonicity() const {
+    auto changes = mIncreases + mDecreases;
+    if (changes == 0) {
+        return 0;
+    }
+    return (static_cast<double>(mIncreases) - static_cast<double>(mDecreases)) / changes;
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <array>
+#include <stdint.h>
+#include <stddef.h>
+
+// Online estimate of how a value grows over time, fed one sample at a time
+// with constant memory, so it can follow every snapshot of long archives.
+// Slopes are in value units per millisecond.
+class Trend {
+public:
+    // samples kept for robustSlope()
+    static constexpr size_t RESERVOIR_SIZE = 64;
+
+    // samples have to be added in timestamp order
+    void add(int64_t timestamp, double value);
+
+    uint64_t sampleCount() const { return mCount; }
+
+    // least squares fit
+    double slope() const;
+
+    // standard error of slope(), 0 with less than 3 samples
+    double slopeError() const;
+
+    // share of the variance explained by the least squares fit
+    double rSquared() const;
+
+    // Theil-Sen estimator, the median of the slopes between all pairs of
+    // kept samples, which ignores outliers like garbage collections
+    double robustSlope() const;
+
+    // 1 if the value only increased, -1 if it only decreased
+    double monotonicity() const;
+
+private:
+    struct Point {
+        double mTime;
+        double mValue;
+    };
+
+    uint64_t mCount = 0;
+
+    // times are relative to the first sample for precision
+    int64_t mOrigin = 0;
+
+    // running means and co-moments (Welford)
+    double mMeanTime = 0;
+    double mMeanValue = 0;
+    double mSxx = 0;
+    double mSxy = 0;
+    double mSyy = 0;
+
+    double mLastValue = 0;
+    uint64_t mIncreases = 0;
+    uint64_t mDecreases = 0;
+
+    // every mStride-th sample, when full every second one is dropped and
+    // the stride doubles, so the kept samples span the whole time range
+    std::array<Point, RESERVOIR_SIZE> mPoints;
+    size_t mPointCount = 0;
+    uint64_t mStride = 1;
+};
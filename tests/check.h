@@ -0,0 +1,38 @@
+#pragma once
+#include <stdio.h>
+
+// Minimal assertions for the tests, every test is a plain executable that
+// ctest runs and that fails with a non-zero exit code.
+
+inline int& checkFailures() {
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            checkFailures()++; \
+        } \
+    } while (false)
+
+#define CHECK_EQUAL(actual, expected) \
+    do { \
+        auto checkActual = (actual); \
+        auto checkExpected = (expected); \
+        if (checkActual != checkExpected) { \
+            printf("%s:%d: check failed: %s is %lld, expected %lld\n", __FILE__, __LINE__, #actual, \
+                   static_cast<long long>(checkActual), static_cast<long long>(checkExpected)); \
+            checkFailures()++; \
+        } \
+    } while (false)
+
+// the exit code of a test
+inline int checkResult() {
+    if (checkFailures() > 0) {
+        printf("%d checks failed\n", checkFailures());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,84 @@
+#include "check.h"
+#include "process.h"
+#include "snapshot.h"
+#include "snapshotdiff.h"
+#include "timeseries.h"
+
+// A process recorded with smaps_rollup and upgraded to full smaps has to
+// keep reporting the same heap usage, otherwise the upgrade shows up as
+// growth in summary, plot, trend and diff. Processes recorded with full
+// smaps only keep counting Referenced of [heap] and anonymous mappings.
+
+static const char* FULL_SMAPS =
+    "55d5c3a00000-55d5c3a21000 rw-p 00000000 00:00 0                          [heap]\n"
+    "Size:                132 kB\n"
+    "Rss:                 120 kB\n"
+    "Referenced:          110 kB\n"
+    "Anonymous:           100 kB\n"
+    "7f0000000000-7f0000010000 rw-p 00000000 00:00 0 \n"
+    "Size:                 64 kB\n"
+    "Rss:                  52 kB\n"
+    "Referenced:           52 kB\n"
+    "Anonymous:            50 kB\n"
+    "7f0000100000-7f0000104000 rw-p 00020000 08:01 1234                       /usr/lib/libfoo.so\n"
+    "Size:                 16 kB\n"
+    "Rss:                  16 kB\n"
+    "Referenced:           16 kB\n"
+    "Anonymous:             8 kB\n"
+    "7ffd8b3de000-7ffd8b3ff000 rw-p 00000000 00:00 0                          [stack]\n"
+    "Size:                132 kB\n"
+    "Rss:                  12 kB\n"
+    "Referenced:           12 kB\n"
+    "Anonymous:            12 kB\n";
+
+// what the kernel reports for the same process in smaps_rollup
+static const char* ROLLUP_SMAPS =
+    "55d5c3a00000-7ffd8b3ff000 ---p 00000000 00:00 0                          [rollup]\n"
+    "Rss:                 200 kB\n"
+    "Referenced:          190 kB\n"
+    "Anonymous:           170 kB\n";
+
+int main() {
+    Snapshot rollup(1, 1000);
+    Snapshot full(1, 2000);
+    CHECK(rollup.parse(ROLLUP_SMAPS));
+    CHECK(full.parse(FULL_SMAPS));
+    CHECK(rollup.isRollup());
+    CHECK(!full.isRollup());
+
+    // the metric of full recordings is unchanged
+    CHECK_EQUAL(full.heapUsage(), 162);
+    CHECK_EQUAL(rollup.heapUsage(), 170);
+
+    Process fullProcess(full.identity(), "full", false);
+    CHECK_EQUAL(fullProcess.heapUsage(full), full.heapUsage());
+
+    // an upgraded process continues with the value of its rollup entry
+    Process upgradedProcess(rollup.identity(), "upgraded", true);
+    CHECK_EQUAL(upgradedProcess.heapUsage(rollup), 170);
+    CHECK_EQUAL(upgradedProcess.heapUsage(full), 170);
+
+    TimeSeries fullSeries;
+    fullSeries.append(full);
+    auto fullHeapUsage = fullSeries.heapUsagePerSample();
+    CHECK_EQUAL(fullHeapUsage.size(), 1u);
+    if (fullHeapUsage.size() == 1) {
+        CHECK_EQUAL(fullHeapUsage[0], full.heapUsage());
+    }
+
+    TimeSeries upgradedSeries;
+    upgradedSeries.append(rollup);
+    upgradedSeries.append(full);
+    auto upgradedHeapUsage = upgradedSeries.heapUsagePerSample();
+    CHECK_EQUAL(upgradedHeapUsage.size(), 2u);
+    if (upgradedHeapUsage.size() == 2) {
+        CHECK_EQUAL(upgradedHeapUsage[0], 170);
+        CHECK_EQUAL(upgradedHeapUsage[1], 170);
+    }
+
+    SnapshotDiff diff;
+    diff.compute(rollup, full, upgradedProcess.isRollup());
+    CHECK_EQUAL(diff.heapDelta(), 0);
+
+    return checkResult();
+}
@@ -0,0 +1,181 @@
+#include "check.h"
+#include "bytereader.h"
+#include "frame.h"
+#include "recorder.h"
+#include "sink.h"
+#include "snapshot.h"
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// A keyframe has to be readable on its own: when taking a process fails
+// during a keyframe sweep, the frames after the keyframe must not refer to
+// a delta base from before it.
+
+static const char* GROWING_COMM = "hh_kf_growing";
+static const char* IDLE_COMM = "hh_kf_idle";
+
+constexpr int KEYFRAME_INTERVAL = 3;
+constexpr int SWEEP_COUNT = 7;
+
+// the take of the growing process that fails, the first take is number 0
+constexpr int FAILED_TAKE = KEYFRAME_INTERVAL;
+
+static pid_t startChild(const char* comm, bool grow) {
+    auto pid = fork();
+    if (pid != 0) {
+        return pid;
+    }
+
+    prctl(PR_SET_NAME, comm);
+    while (true) {
+        if (grow) {
+            auto memory = malloc(256 * 1024);
+            memset(memory, 1, 256 * 1024);
+        }
+        usleep(20 * 1000);
+    }
+}
+
+class FailingRecorder : public Recorder {
+public:
+    explicit FailingRecorder(pid_t failingPid) : mFailingPid(failingPid) {}
+
+protected:
+    bool takeSnapshot(Snapshot& snapshot, Snapshot::Source source) override {
+        if (snapshot.processId() == mFailingPid && mTakes++ == FAILED_TAKE) {
+            return false;
+        }
+        return Recorder::takeSnapshot(snapshot, source);
+    }
+
+private:
+    pid_t mFailingPid;
+
+    int mTakes = 0;
+};
+
+// the snapshots of one frame, killed markers are left out
+using DecodedFrame = std::vector<std::unique_ptr<Snapshot>>;
+
+// decodes the archive from the frame at offset on, false if a frame or a
+// snapshot fails to decode
+static bool decode(const std::string& archive, size_t offset, std::vector<DecodedFrame>& frames) {
+    // delta bases point into frames
+    std::map<ProcessIdentity, Snapshot*> prevSnapshots;
+    const std::map<ProcessIdentity, Snapshot*> noPrevSnapshots;
+
+    ByteReader reader(archive);
+    reader.seek(offset);
+    std::string buffer;
+    while (true) {
+        bool keyframe = false;
+        std::string_view data;
+        auto res = readFrame(reader, buffer, data, keyframe);
+        if (res == ReadFrameResult::end) {
+            return true;
+        }
+        if (res != ReadFrameResult::ok) {
+            return false;
+        }
+
+        frames.emplace_back();
+        ByteReader frameReader(data);
+        while (!frameReader.atEnd()) {
+            auto snapshot = std::make_unique<Snapshot>();
+            auto res = snapshot->readFromFile(frameReader, ARCHIVE_VERSION, keyframe ? noPrevSnapshots : prevSnapshots);
+            if (res == Snapshot::ReadFileResult::failed) {
+                return false;
+            }
+            if (res == Snapshot::ReadFileResult::killed) {
+                prevSnapshots.erase(snapshot->identity());
+                continue;
+            }
+
+            prevSnapshots[snapshot->identity()] = snapshot.get();
+            frames.back().push_back(std::move(snapshot));
+        }
+    }
+}
+
+// offsets of all keyframes after the archive header
+static std::vector<size_t> keyframeOffsets(const std::string& archive) {
+    std::vector<size_t> offsets;
+    ByteReader reader(archive);
+    reader.seek(sizeof(uint32_t));
+    while (true) {
+        auto offset = reader.offset();
+        bool keyframe = false;
+        if (skipFrame(reader, keyframe) != ReadFrameResult::ok) {
+            break;
+        }
+        if (keyframe) {
+            offsets.push_back(offset);
+        }
+    }
+    return offsets;
+}
+
+int main() {
+    pid_t growing = startChild(GROWING_COMM, true);
+    pid_t idle = startChild(IDLE_COMM, false);
+
+    // the filter only matches once the children renamed themselves
+    usleep(100 * 1000);
+
+    ProcessFilter filter;
+    filter.addComm(GROWING_COMM);
+    filter.addComm(IDLE_COMM);
+
+    // owned by the recorder, which outlives the checks
+    auto sink = std::make_unique<MemorySink>();
+    auto& archive = *sink;
+
+    FailingRecorder recorder(growing);
+    recorder.setSink(std::move(sink));
+    recorder.setProcessFilter(filter);
+    recorder.setSampleInterval(std::chrono::milliseconds(100));
+    recorder.setSampleCount(SWEEP_COUNT);
+    recorder.setKeyframeInterval(KEYFRAME_INTERVAL);
+    recorder.record();
+
+    kill(growing, SIGKILL);
+    kill(idle, SIGKILL);
+    waitpid(growing, nullptr, 0);
+    waitpid(idle, nullptr, 0);
+
+    const auto& data = archive.data();
+    std::vector<DecodedFrame> all;
+    CHECK(decode(data, sizeof(uint32_t), all));
+    CHECK_EQUAL(all.size(), static_cast<size_t>(SWEEP_COUNT));
+
+    // the failed take is in the second keyframe, every keyframe has to
+    // decode to the same snapshots as reading the archive from the start
+    auto keyframes = keyframeOffsets(data);
+    CHECK_EQUAL(keyframes.size(), static_cast<size_t>((SWEEP_COUNT + KEYFRAME_INTERVAL - 1) / KEYFRAME_INTERVAL));
+    for (size_t i = 0; i < keyframes.size(); i++) {
+        std::vector<DecodedFrame> fromKeyframe;
+        CHECK(decode(data, keyframes[i], fromKeyframe));
+
+        auto first = all.size() - fromKeyframe.size();
+        CHECK_EQUAL(first, i * KEYFRAME_INTERVAL);
+        for (size_t frame = 0; frame < fromKeyframe.size(); frame++) {
+            const auto& expected = all[first + frame];
+            const auto& actual = fromKeyframe[frame];
+            CHECK_EQUAL(actual.size(), expected.size());
+            for (size_t index = 0; index < actual.size() && index < expected.size(); index++) {
+                CHECK(actual[index]->identity() == expected[index]->identity());
+                CHECK(actual[index]->isEqualTo(*expected[index]));
+            }
+        }
+    }
+
+    return checkResult();
+}
@@ -0,0 +1,64 @@
+#include "check.h"
+#include "processfilter.h"
+#include <algorithm>
+#include <vector>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// The filter caches its result per process. A process that is evaluated
+// between fork() and execve() has the command line of its parent at that
+// time, so it has to be evaluated again after the exec.
+
+static bool contains(const std::vector<pid_t>& pids, pid_t pid) {
+    return std::find(pids.begin(), pids.end(), pid) != pids.end();
+}
+
+int main() {
+    // the child execs when the parent closes start, done is closed by the
+    // exec because of O_CLOEXEC
+    int start[2];
+    int done[2];
+    if (pipe(start) != 0 || pipe2(done, O_CLOEXEC) != 0) {
+        printf("failed to create pipes\n");
+        return 1;
+    }
+
+    auto pid = fork();
+    if (pid == 0) {
+        close(start[1]);
+        close(done[0]);
+        char c;
+        while (read(start[0], &c, 1) < 0) {
+        }
+        execl("/bin/sleep", "sleep", "10", nullptr);
+        _exit(1);
+    }
+    close(start[0]);
+    close(done[1]);
+
+    ProcessFilter parentFilter;
+    CHECK(parentFilter.addInclude("processfilter_test"));
+    ProcessFilter sleepFilter;
+    CHECK(sleepFilter.addInclude("^sleep 10$"));
+
+    // before the exec the child runs the executable of the test
+    std::vector<pid_t> pids = {pid};
+    CHECK(contains(parentFilter.apply(pids), pid));
+    CHECK(!contains(sleepFilter.apply(pids), pid));
+
+    close(start[1]);
+    char c;
+    while (read(done[0], &c, 1) < 0) {
+    }
+    close(done[0]);
+
+    CHECK(!contains(parentFilter.apply(pids), pid));
+    CHECK(contains(sleepFilter.apply(pids), pid));
+
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+
+    return checkResult();
+}